@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+
+/// `constexpr` versions of the few math functions needed to build ray tables
+/// at compile time. They are only used for table generation (never in a hot
+/// loop), and are accurate enough that every value they produce for the ray
+/// tables rounds to the same `float` as the `<cmath>` functions.
+namespace constexpr_math {
+
+namespace detail {
+    // pi / 2 split into three parts, so that `k * pi_2_hi` and `k * pi_2_mid`
+    // are exact and the argument reduction keeps its precision
+    constexpr long double pi_2_hi = 0xc90fdaa2p-31L;
+    constexpr long double pi_2_mid = 0x85a308d3p-65L;
+    constexpr long double pi_2_lo = 0x98cc51701b839a25p-132L;
+
+    /// Reduces `angle` to `[-pi / 4, pi / 4]`
+    /// @returns the reduced angle and the quadrant it was in
+    constexpr auto reduce(const double angle, int64_t& quadrant) -> long double
+    {
+        const long double a = angle;
+        const long double k = static_cast<long double>(static_cast<int64_t>(a / (pi_2_hi + pi_2_mid) + (a < 0 ? -0.5L : 0.5L)));
+        quadrant = static_cast<int64_t>(k);
+        return ((a - k * pi_2_hi) - k * pi_2_mid) - k * pi_2_lo;
+    }
+
+    /// Taylor series of sine, only accurate for `|x| <= pi / 4`
+    constexpr auto sin_reduced(const long double x) -> long double
+    {
+        long double term = x;
+        long double sum = x;
+        for (int n = 1; n < 14; ++n) {
+            term *= -x * x / static_cast<long double>((2 * n) * (2 * n + 1));
+            sum += term;
+        }
+        return sum;
+    }
+
+    /// Taylor series of cosine, only accurate for `|x| <= pi / 4`
+    constexpr auto cos_reduced(const long double x) -> long double
+    {
+        long double term = 1;
+        long double sum = 1;
+        for (int n = 1; n < 14; ++n) {
+            term *= -x * x / static_cast<long double>((2 * n - 1) * (2 * n));
+            sum += term;
+        }
+        return sum;
+    }
+}
+
+constexpr auto cos(const double angle) -> double
+{
+    int64_t quadrant = 0;
+    const long double x = detail::reduce(angle, quadrant);
+    switch (quadrant & 3) {
+        case 0: return static_cast<double>(detail::cos_reduced(x));
+        case 1: return static_cast<double>(-detail::sin_reduced(x));
+        case 2: return static_cast<double>(-detail::cos_reduced(x));
+        default: return static_cast<double>(detail::sin_reduced(x));
+    }
+}
+
+constexpr auto sin(const double angle) -> double
+{
+    int64_t quadrant = 0;
+    const long double x = detail::reduce(angle, quadrant);
+    switch (quadrant & 3) {
+        case 0: return static_cast<double>(detail::sin_reduced(x));
+        case 1: return static_cast<double>(detail::cos_reduced(x));
+        case 2: return static_cast<double>(-detail::sin_reduced(x));
+        default: return static_cast<double>(-detail::cos_reduced(x));
+    }
+}
+
+/// Newton's method, converges from above
+constexpr auto sqrt(const double value) -> double
+{
+    if (!(value > 0)) { return 0; }
+
+    double guess = value > 1 ? value : 1;
+    for (int i = 0; i < 2048; ++i) {
+        const double next = 0.5 * (guess + value / guess);
+        if (next >= guess) { break; }
+        guess = next;
+    }
+    return guess;
+}
+
+/// `sqrt` for a `float`, rounded the same way as `std::sqrt(float)`
+constexpr auto sqrt(const float value) -> float
+{
+    return static_cast<float>(sqrt(static_cast<double>(value)));
+}
+
+} // namespace constexpr_math
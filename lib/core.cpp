@@ -1,10 +1,11 @@
 #include "core.hpp"
 #include <iostream>
 
-auto read_input(const std::filesystem::path input_file) -> std::vector<int16_t>
+template<typename Allocator>
+auto read_input(const std::filesystem::path input_file) -> std::vector<int16_t, Allocator>
 {
     // set up an empty vector to store the data 
-    std::vector<int16_t> input_data;
+    std::vector<int16_t, Allocator> input_data;
     
     // check that the file is valid
     if (input_file.extension() != ".raw") {
@@ -56,3 +57,6 @@ auto read_input(const std::filesystem::path input_file) -> std::vector<int16_t>
     // return our data
     return input_data;
 }
+
+template auto read_input<std::allocator<int16_t>>(const std::filesystem::path input_file) -> std::vector<int16_t>;
+template auto read_input<huge_page_allocator<int16_t>>(const std::filesystem::path input_file) -> huge_vector<int16_t>;
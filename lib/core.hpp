@@ -6,11 +6,14 @@
 #include "mdspan.hpp"
 #include "timer.hpp"
 #include "ray_casting.hpp"
+#include "huge_pages.hpp"
 #include <filesystem>
+#include <memory>
 #include <vector>
 #include <span.hpp>
 #include <fmt/core.h>
 #include <fstream>
+#include <type_traits>
 
 // ----------- Data Structures -----------
 using vec3_i16 = vec3<int16_t>;
@@ -22,16 +25,76 @@ using index2 = vec2<int64_t>;
 using mat_2d_exts = Kokkos::dextents<size_t, 2>;
 using mat_2d_u8 = Kokkos::mdspan<uint8_t, mat_2d_exts>;
 using mat_2d_i16 = Kokkos::mdspan<int16_t, mat_2d_exts>;
+using mat_2d_u32 = Kokkos::mdspan<uint32_t, mat_2d_exts>;
 using mat_2d_f32 = Kokkos::mdspan<float, mat_2d_exts>;
 
+/// A row-major view over a two dimensional grid, laid out like the input
+/// files: element `(row, col)` is `data[row * cols + col]`. Walking along
+/// the columns of a row reads contiguous memory, so the innermost loop over
+/// a grid should always be the one over `col`.
+///
+/// Like the spans, the grid doesn't own its data.
+template<typename T>
+class grid2d {
+public:
+    using value_type = T;
+
+    constexpr grid2d() = default;
+    constexpr grid2d(T* data, const size_t rows, const size_t cols) : data_(data), rows_(rows), cols_(cols) {}
+
+    /// @returns the number of rows (the height of the grid)
+    [[nodiscard]] constexpr auto rows() const noexcept -> size_t { return rows_; }
+
+    /// @returns the number of columns (the width of the grid)
+    [[nodiscard]] constexpr auto cols() const noexcept -> size_t { return cols_; }
+
+    /// @returns the number of elements
+    [[nodiscard]] constexpr auto size() const noexcept -> size_t { return rows_ * cols_; }
+
+    [[nodiscard]] constexpr auto data() const noexcept -> T* { return data_; }
+
+    /// @returns true if `(row, col)` is inside of the grid
+    template<typename Index>
+    [[nodiscard]] constexpr auto contains(const Index row, const Index col) const noexcept -> bool
+    {
+        static_assert(std::is_integral_v<Index>, "Grid indices must be integers.");
+        if constexpr (std::is_signed_v<Index>) {
+            if (row < 0 || col < 0) { return false; }
+        }
+        return static_cast<size_t>(row) < rows_ && static_cast<size_t>(col) < cols_;
+    }
+
+    /// @returns the element in row `row` and column `col`
+    template<typename Row, typename Col>
+    [[nodiscard]] constexpr auto operator()(const Row row, const Col col) const noexcept -> T&
+    {
+        static_assert(std::is_integral_v<Row> && std::is_integral_v<Col>, "Grid indices must be integers.");
+        return data_[static_cast<size_t>(row) * cols_ + static_cast<size_t>(col)];
+    }
+
+    /// @returns the elements of row `row`
+    [[nodiscard]] auto row(const size_t row) const noexcept -> tcb::span<T> { return tcb::span<T>(data_ + row * cols_, cols_); }
+
+private:
+    T* data_{nullptr};
+    size_t rows_{0};
+    size_t cols_{0};
+};
+
+using grid_i16 = grid2d<int16_t>;
+using grid_u8 = grid2d<uint8_t>;
+
 
 
 // ----------- Functions -----------
 /// Reads the input file in the given format.
 /// @param input_file The path to the input file 
+/// @tparam Allocator `std::allocator` or `huge_page_allocator`, to read the
+///         heights onto huge pages
 /// @returns The data values from the input file as a std::vector
+template<typename Allocator = std::allocator<int16_t>>
 [[nodiscard]]
-auto read_input(const std::filesystem::path input_file) -> std::vector<int16_t>;
+auto read_input(const std::filesystem::path input_file) -> std::vector<int16_t, Allocator>;
 
 /// Write the output to the given path
 /// @param output_file The path to the output file 
@@ -83,4 +146,22 @@ auto to_span(tcb::span<T> input_data,
 
     return Kokkos::mdspan(input_data.data(), width, length);
 }
+
+/// Wraps row-major data, like the contents of an input file, in a `grid2d`
+/// with `height` rows of `width` elements.
+/// @param input_data A span over the data, which still owns it
+/// @param width The width of the grid (the number of columns)
+/// @param height The height of the grid (the number of rows)
+/// @returns The grid, or an empty one if the sizes don't match
+template<typename T>
+[[nodiscard]]
+auto to_grid(tcb::span<T> input_data, const size_t width, const size_t height) -> grid2d<T>
+{
+    if (width * height != input_data.size()) {
+        fmt::println("Input size mismatch!");
+        return {};
+    }
+
+    return grid2d<T>(input_data.data(), height, width);
+}
                 
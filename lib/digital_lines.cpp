@@ -0,0 +1,54 @@
+#include "digital_lines.hpp"
+#include <algorithm>
+#include <cmath>
+
+DigitalLines::DigitalLines(const size_t width, const size_t height, const double angle)
+    : width_(width)
+{
+    const double cos = std::cos(angle);
+    const double sin = std::sin(angle);
+
+    // Step one cell at a time along the axis the direction is closest to
+    x_major_ = std::abs(cos) >= std::abs(sin);
+    const double major_step = x_major_ ? cos : sin;
+    const double minor_step = x_major_ ? sin : cos;
+    const double slope = minor_step / major_step;
+
+    major_size_ = x_major_ ? width : height;
+    const size_t minor_size = x_major_ ? height : width;
+    reversed_ = major_step < 0;
+    step_ = std::sqrt(1.0 + slope * slope);
+
+    offsets_.resize(major_size_);
+    for (size_t major = 0; major < major_size_; ++major) {
+        offsets_[major] = std::lround(slope * static_cast<double>(major));
+    }
+
+    if (major_size_ == 0 || minor_size == 0) { return; }
+
+    // Every line through at least one cell of the map
+    const auto [lowest, highest] = std::minmax_element(offsets_.begin(), offsets_.end());
+    first_line_ = -*highest;
+    const auto num_lines = static_cast<size_t>(static_cast<int64_t>(minor_size) + *highest - *lowest);
+
+    begin_.resize(num_lines);
+    end_.resize(num_lines);
+    const bool increasing = slope >= 0;
+    const auto minor_end = static_cast<int64_t>(minor_size);
+
+    for (size_t line = 0; line < num_lines; ++line) {
+        const int64_t base = static_cast<int64_t>(line) + first_line_;
+
+        // The offsets are monotonic, so every line is on the map for one
+        // contiguous range of major coordinates
+        const auto first = increasing
+            ? std::partition_point(offsets_.begin(), offsets_.end(), [&](const int64_t offset) { return base + offset < 0; })
+            : std::partition_point(offsets_.begin(), offsets_.end(), [&](const int64_t offset) { return base + offset >= minor_end; });
+        const auto last = increasing
+            ? std::partition_point(first, offsets_.end(), [&](const int64_t offset) { return base + offset < minor_end; })
+            : std::partition_point(first, offsets_.end(), [&](const int64_t offset) { return base + offset >= 0; });
+
+        begin_[line] = static_cast<size_t>(first - offsets_.begin());
+        end_[line] = static_cast<size_t>(last - offsets_.begin());
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// The digital lines of one direction through a `width` by `height` map.
+///
+/// Every cell of the map is on exactly one line, and every line takes one
+/// cell per column (or per row, for directions closer to vertical), so all
+/// the lines have the same shape. Walking a line in order visits its cells
+/// in the direction of `angle`, which lets the engines that work one
+/// direction at a time load a whole line into a contiguous buffer once and
+/// share it between every observer on it.
+class DigitalLines {
+public:
+    /// @param angle the direction of the lines in radians (0 is +x, pi / 2 is +y)
+    DigitalLines(const size_t width, const size_t height, const double angle);
+
+    /// @returns the number of lines
+    [[nodiscard]] auto num_lines() const noexcept -> size_t { return begin_.size(); }
+
+    /// @returns the number of cells on `line`
+    [[nodiscard]] auto line_length(const size_t line) const noexcept -> size_t { return end_[line] - begin_[line]; }
+
+    /// @returns the length of the longest line
+    [[nodiscard]] auto max_line_length() const noexcept -> size_t { return major_size_; }
+
+    /// @returns the distance between two consecutive cells of a line, along `angle`
+    [[nodiscard]] auto step() const noexcept -> double { return step_; }
+
+    /// @returns the map index (`y * width + x`) of cell `i` of `line`
+    [[nodiscard]] auto cell(const size_t line, const size_t i) const noexcept -> size_t
+    {
+        // Lines that run backwards along the major axis are walked from their end
+        const size_t major = reversed_ ? end_[line] - 1 - i : begin_[line] + i;
+        const auto minor = static_cast<size_t>(static_cast<int64_t>(line) + first_line_ + offsets_[major]);
+
+        return x_major_ ? minor * width_ + major : major * width_ + minor;
+    }
+
+    /// @returns the line that cell `(x, y)` is on
+    [[nodiscard]] auto line_of(const size_t x, const size_t y) const noexcept -> size_t
+    {
+        const size_t major = x_major_ ? x : y;
+        const size_t minor = x_major_ ? y : x;
+        return static_cast<size_t>(static_cast<int64_t>(minor) - first_line_ - offsets_[major]);
+    }
+
+    /// @returns how far along the major axis cell `(x, y)` is, counted in the
+    ///          direction of the lines. Cell `i` of every line is at position
+    ///          `first_position(line) + i`, so a buffer with one row of
+    ///          `max_line_length()` positions per line holds the map sheared
+    ///          into the direction.
+    [[nodiscard]] auto position_of(const size_t x, const size_t y) const noexcept -> size_t
+    {
+        const size_t major = x_major_ ? x : y;
+        return reversed_ ? major_size_ - 1 - major : major;
+    }
+
+    /// @returns the position of the first cell of `line`
+    [[nodiscard]] auto first_position(const size_t line) const noexcept -> size_t
+    {
+        return reversed_ ? major_size_ - end_[line] : begin_[line];
+    }
+
+private:
+    size_t width_;
+    size_t major_size_{0};
+    /// Lines step along x (instead of y)
+    bool x_major_{true};
+    /// Lines run towards smaller major coordinates
+    bool reversed_{false};
+    double step_{1.0};
+    /// The minor coordinate of line 0 at major coordinate 0
+    int64_t first_line_{0};
+    /// How far the lines have moved along the minor axis at every major coordinate
+    std::vector<int64_t> offsets_;
+    /// The range of major coordinates that every line covers
+    std::vector<size_t> begin_;
+    std::vector<size_t> end_;
+};
@@ -0,0 +1,68 @@
+#include "height_pyramid.hpp"
+#include <algorithm>
+
+HeightPyramid::HeightPyramid(const tcb::span<const int16_t> height_map, const size_t width, const size_t height)
+{
+    // Level 0 is the map read the way the kernels read it
+    levels_.reserve(height_map.size() + height_map.size() / 2);
+    for (const int16_t value : height_map) {
+        levels_.push_back(static_cast<uint16_t>(value));
+    }
+    level_offsets_.push_back(0);
+    widths_.push_back(width);
+
+    // Halve the previous level until a single block covers the whole map
+    size_t level_width = width;
+    size_t level_height = height;
+    while (level_width > 1 || level_height > 1) {
+        const size_t next_width = (level_width + 1) / 2;
+        const size_t next_height = (level_height + 1) / 2;
+        const size_t offset = level_offsets_.back();
+        const size_t next_offset = levels_.size();
+        levels_.resize(next_offset + next_width * next_height, 0);
+
+        for (size_t y = 0; y < level_height; ++y) {
+            for (size_t x = 0; x < level_width; ++x) {
+                auto& block = levels_[next_offset + (y / 2) * next_width + x / 2];
+                block = std::max(block, levels_[offset + y * level_width + x]);
+            }
+        }
+
+        level_offsets_.push_back(next_offset);
+        widths_.push_back(next_width);
+        level_width = next_width;
+        level_height = next_height;
+    }
+}
+
+RaySegments::RaySegments(const RayStencil& stencil, const size_t length)
+{
+    ray_offsets_.push_back(0);
+
+    for (size_t ray = 0; ray < stencil.num_rays(); ++ray) {
+        for (size_t begin = stencil.ray_begin(ray); begin < stencil.ray_end(ray); begin += length) {
+            const size_t end = std::min(begin + length, stencil.ray_end(ray));
+
+            Segment segment{
+                static_cast<uint32_t>(begin), static_cast<uint32_t>(end),
+                stencil.dx()[begin], stencil.dx()[begin], stencil.dy()[begin], stencil.dy()[begin],
+                stencil.inv_dist()[begin], stencil.inv_dist()[begin], 0};
+
+            for (size_t step = begin; step < end; ++step) {
+                segment.min_dx = std::min(segment.min_dx, stencil.dx()[step]);
+                segment.max_dx = std::max(segment.max_dx, stencil.dx()[step]);
+                segment.min_dy = std::min(segment.min_dy, stencil.dy()[step]);
+                segment.max_dy = std::max(segment.max_dy, stencil.dy()[step]);
+                segment.min_inv_dist = std::min(segment.min_inv_dist, stencil.inv_dist()[step]);
+                segment.max_inv_dist = std::max(segment.max_inv_dist, stencil.inv_dist()[step]);
+            }
+
+            // The size of the box doesn't depend on where the observer is
+            const auto extent = std::max(segment.max_dx - segment.min_dx, segment.max_dy - segment.min_dy);
+            segment.level = HeightPyramid::level_for(static_cast<size_t>(extent));
+
+            segments_.push_back(segment);
+        }
+        ray_offsets_.push_back(static_cast<uint32_t>(segments_.size()));
+    }
+}
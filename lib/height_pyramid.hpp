@@ -0,0 +1,235 @@
+#pragma once
+
+#include "ray_casting.hpp"
+#include "ray_stencil.hpp"
+#include <span.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/// A mip chain of block maxima over a height map. Level `k` stores the
+/// largest height (as an `unsigned short`, like the kernels read it) of every
+/// `2^k` by `2^k` block of the map, so level 0 is the map itself.
+///
+/// It answers "how high does the terrain get in this rectangle" with at most
+/// four lookups, which lets `pruned_row_visibility` prove that a stretch of
+/// a ray can't rise above the horizon and skip it.
+class HeightPyramid {
+public:
+    /// Builds every level, up to a single block covering the whole map
+    HeightPyramid(const tcb::span<const int16_t> height_map, const size_t width, const size_t height);
+
+    /// @returns the number of levels, including the map itself
+    [[nodiscard]] auto num_levels() const noexcept -> size_t { return widths_.size(); }
+
+    /// @returns the smallest level whose blocks are at least `extent + 1`
+    ///          cells wide, so a rectangle spanning `extent + 1` cells
+    ///          overlaps at most two of them in either direction
+    [[nodiscard]] static constexpr auto level_for(size_t extent) noexcept -> uint32_t
+    {
+        uint32_t level = 0;
+        for (; extent != 0; extent >>= 1) { ++level; }
+        return level;
+    }
+
+    /// @returns an upper bound of the heights in `[x_begin, x_end] x [y_begin, y_end]`
+    ///          (both inclusive and inside of the map), read from `level`
+    /// @param level at least `level_for` the larger side of the rectangle
+    [[nodiscard]] auto max_in(
+        uint32_t level, const size_t x_begin, const size_t y_begin, const size_t x_end, const size_t y_end) const noexcept
+        -> uint16_t
+    {
+        level = std::min(level, static_cast<uint32_t>(widths_.size() - 1));
+        const uint16_t* const blocks = levels_.data() + level_offsets_[level];
+        const size_t level_width = widths_[level];
+
+        const size_t top = (y_begin >> level) * level_width;
+        const size_t bottom = (y_end >> level) * level_width;
+        const size_t left = x_begin >> level;
+        const size_t right = x_end >> level;
+
+        // Overlapping blocks are just read twice
+        return std::max(std::max(blocks[top + left], blocks[top + right]),
+                        std::max(blocks[bottom + left], blocks[bottom + right]));
+    }
+
+    /// @returns an upper bound of the heights in `[x_begin, x_end] x [y_begin, y_end]`
+    ///          (both inclusive and inside of the map)
+    [[nodiscard]] auto max_in(const size_t x_begin, const size_t y_begin, const size_t x_end, const size_t y_end) const noexcept
+        -> uint16_t
+    {
+        return max_in(level_for(std::max(x_end - x_begin, y_end - y_begin)), x_begin, y_begin, x_end, y_end);
+    }
+
+private:
+    /// Every level back to back, starting with the map itself
+    std::vector<uint16_t> levels_;
+    std::vector<size_t> level_offsets_;
+    std::vector<size_t> widths_;
+};
+
+/// The rays of a `RayStencil` cut into segments of a few consecutive steps,
+/// each with the bounds that `pruned_row_visibility` checks against a
+/// `HeightPyramid` before walking it.
+class RaySegments {
+public:
+    struct Segment {
+        /// The steps `[begin, end)` of the stencil
+        uint32_t begin;
+        uint32_t end;
+        /// The bounding box of the steps' offsets
+        int32_t min_dx;
+        int32_t max_dx;
+        int32_t min_dy;
+        int32_t max_dy;
+        /// The smallest and largest `inv_dist` of the steps
+        float min_inv_dist;
+        float max_inv_dist;
+        /// The pyramid level to look the bounding box up in
+        uint32_t level;
+    };
+
+    /// @param length the number of steps per segment (the last one of a ray can be shorter)
+    RaySegments(const RayStencil& stencil, const size_t length);
+
+    /// @returns the index of the first segment of `ray`
+    [[nodiscard]] auto ray_begin(const size_t ray) const noexcept -> size_t { return ray_offsets_[ray]; }
+
+    /// @returns one past the index of the last segment of `ray`
+    [[nodiscard]] auto ray_end(const size_t ray) const noexcept -> size_t { return ray_offsets_[ray + 1]; }
+
+    /// @returns every segment of every ray
+    [[nodiscard]] auto segments() const noexcept -> const std::vector<Segment>& { return segments_; }
+
+private:
+    std::vector<Segment> segments_;
+    std::vector<uint32_t> ray_offsets_;
+};
+
+namespace detail {
+
+template<bool CheckBounds>
+inline auto pruned_pixel_visibility(
+    const size_t x,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    const RaySegments& segments,
+    const HeightPyramid& pyramid) -> unsigned int
+{
+    // Get the height of the current pixel
+    const auto current_height = static_cast<float>(static_cast<uint16_t>(height_map[y * width + x]));
+
+    // Start the count at this cell as 1 (the pixel itself is always visible)
+    unsigned int visible_count = 1;
+
+    const int32_t* const offsets_x = stencil.dx().data();
+    const int32_t* const offsets_y = stencil.dy().data();
+    const float* const inv_dist = stencil.inv_dist().data();
+    const RaySegments::Segment* const bounds = segments.segments().data();
+
+    const auto x_i = static_cast<int64_t>(x);
+    const auto y_i = static_cast<int64_t>(y);
+
+    // Cast rays in different directions
+    for (size_t ray = 0; ray < stencil.num_rays(); ++ray) {
+        float max_angle_seen = -std::numeric_limits<float>::infinity();
+
+        for (size_t segment = segments.ray_begin(ray); segment < segments.ray_end(ray); ++segment) {
+            const auto& bound = bounds[segment];
+
+            // The scalar kernel stops a ray at its first step off the map, so
+            // segments that leave it are always walked (and checked)
+            const bool inside = !CheckBounds ||
+                (x_i + bound.min_dx >= 0 && x_i + bound.max_dx < static_cast<int64_t>(width) &&
+                 y_i + bound.min_dy >= 0 && y_i + bound.max_dy < static_cast<int64_t>(height));
+
+            if (inside) {
+                // The highest terrain around the segment, at the closest
+                // distance (or the farthest, if it is below the observer),
+                // bounds the angle of every step. Rounding is monotonic, so
+                // this holds for the rounded angles too.
+                const auto max_height = pyramid.max_in(bound.level,
+                    static_cast<size_t>(x_i + bound.min_dx), static_cast<size_t>(y_i + bound.min_dy),
+                    static_cast<size_t>(x_i + bound.max_dx), static_cast<size_t>(y_i + bound.max_dy));
+                const float height_diff = static_cast<float>(max_height) - current_height;
+                const float max_angle = height_diff * (height_diff >= 0 ? bound.max_inv_dist : bound.min_inv_dist);
+
+                if (!(max_angle > max_angle_seen)) {
+                    continue; // Nothing in this segment can be visible
+                }
+            }
+
+            bool off_the_map = false;
+            for (size_t step = bound.begin; step < bound.end; ++step) {
+                const int curr_x = static_cast<int>(x) + offsets_x[step];
+                const int curr_y = static_cast<int>(y) + offsets_y[step];
+
+                // Check bounds (more likely to fail early for edge pixels)
+                if constexpr (CheckBounds) {
+                    if (curr_x < 0 || curr_x >= static_cast<int>(width) ||
+                        curr_y < 0 || curr_y >= static_cast<int>(height)) {
+                        off_the_map = true;
+                        break; // Ray went out of bounds
+                    }
+                }
+
+                // Get height at the current position on the ray
+                const auto index = static_cast<size_t>(curr_y) * width + static_cast<size_t>(curr_x);
+                const auto point_height = static_cast<float>(static_cast<uint16_t>(height_map[index]));
+
+                // Calculate the vertical angle to this point
+                const float angle = (point_height - current_height) * inv_dist[step];
+
+                if (angle > max_angle_seen) {
+                    max_angle_seen = angle;
+                    visible_count++;
+                }
+            }
+
+            if (off_the_map) {
+                break;
+            }
+        }
+    }
+
+    return visible_count;
+}
+
+} // namespace detail
+
+/// `row_visibility`, but skips the segments of every ray that `pyramid`
+/// shows to be hidden. Produces exactly the same counts.
+/// @param segments `stencil` cut into segments
+/// @param pyramid the block maxima of `height_map`
+static inline auto pruned_row_visibility(
+    const size_t y,
+    const size_t x_begin,
+    const size_t x_end,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    const RaySegments& segments,
+    const HeightPyramid& pyramid,
+    const InteriorRegion& interior,
+    unsigned int* output) -> void
+{
+    // Rows near the top and bottom are border pixels all the way through
+    const size_t inner_begin = interior.contains_row(y) ? std::clamp(interior.x_begin, x_begin, x_end) : x_end;
+    const size_t inner_end = interior.contains_row(y) ? std::clamp(interior.x_end, inner_begin, x_end) : x_end;
+
+    size_t x = x_begin;
+    for (; x < inner_begin; ++x) {
+        output[x - x_begin] = detail::pruned_pixel_visibility<true>(x, y, width, height, height_map, stencil, segments, pyramid);
+    }
+    for (; x < inner_end; ++x) {
+        output[x - x_begin] = detail::pruned_pixel_visibility<false>(x, y, width, height, height_map, stencil, segments, pyramid);
+    }
+    for (; x < x_end; ++x) {
+        output[x - x_begin] = detail::pruned_pixel_visibility<true>(x, y, width, height, height_map, stencil, segments, pyramid);
+    }
+}
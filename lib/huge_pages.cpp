@@ -0,0 +1,132 @@
+#include "huge_pages.hpp"
+#include <fmt/core.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace {
+    /// Allocations smaller than this aren't worth a huge page of their own
+    constexpr size_t MinMappedBytes = HugePageSize / 2;
+
+    /// @returns `bytes` rounded up to whole huge pages
+    auto mapped_size(const size_t bytes) -> size_t
+    {
+        return (bytes + HugePageSize - 1) / HugePageSize * HugePageSize;
+    }
+
+#ifdef __linux__
+    /// @returns `size` bytes of normal pages aligned to a huge page, marked
+    ///          for transparent huge pages, or nullptr
+    auto map_transparent(const size_t size) -> void*
+    {
+        // Map a huge page more than needed and cut off what sticks out on
+        // either side of the aligned range
+        void* mapping = mmap(nullptr, size + HugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) { return nullptr; }
+
+        const auto begin = reinterpret_cast<uintptr_t>(mapping);
+        const uintptr_t aligned = (begin + HugePageSize - 1) / HugePageSize * HugePageSize;
+        if (aligned > begin) { munmap(mapping, aligned - begin); }
+        munmap(reinterpret_cast<void*>(aligned + size), HugePageSize - (aligned - begin));
+
+        // Only a hint: the pages stay normal ones if the kernel has none
+#ifdef MADV_HUGEPAGE
+        madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+#endif
+        return reinterpret_cast<void*>(aligned);
+    }
+#endif
+}
+
+auto huge_page_allocate(const size_t bytes) -> void*
+{
+#ifdef __linux__
+    if (bytes >= MinMappedBytes) {
+        const size_t size = mapped_size(bytes);
+
+        // Explicit huge pages only exist if the administrator reserved them
+#ifdef MAP_HUGETLB
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data != MAP_FAILED) { return data; }
+#endif
+        return map_transparent(size);
+    }
+#endif
+
+    return ::operator new(bytes, std::nothrow);
+}
+
+auto huge_page_free(void* data, const size_t bytes) -> void
+{
+    if (data == nullptr) { return; }
+
+#ifdef __linux__
+    if (bytes >= MinMappedBytes) {
+        munmap(data, mapped_size(bytes));
+        return;
+    }
+#endif
+
+    ::operator delete(data);
+}
+
+auto huge_page_usage(const void* data, const size_t bytes) -> HugePageUsage
+{
+    HugePageUsage usage;
+    usage.bytes = bytes;
+
+    const auto begin = reinterpret_cast<uintptr_t>(data);
+    const uintptr_t end = begin + bytes;
+
+    // Every mapping is a line with its address range followed by lines of
+    // `Field: value kB`
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    size_t overlap = 0;
+    while (std::getline(smaps, line)) {
+        unsigned long long first = 0;
+        unsigned long long last = 0;
+        if (std::sscanf(line.c_str(), "%llx-%llx ", &first, &last) == 2) {
+            const uintptr_t overlap_begin = std::max<uintptr_t>(begin, first);
+            const uintptr_t overlap_end = std::min<uintptr_t>(end, last);
+            overlap = overlap_end > overlap_begin ? overlap_end - overlap_begin : 0;
+            continue;
+        }
+        if (overlap == 0) { continue; }
+
+        std::istringstream fields(line);
+        std::string field;
+        size_t kilobytes = 0;
+        fields >> field >> kilobytes;
+
+        if (field == "KernelPageSize:" && kilobytes * 1024 >= HugePageSize) {
+            usage.huge_bytes += overlap;
+            usage.explicit_pages = true;
+        } else if (field == "AnonHugePages:") {
+            // A mapping can reach past the range, so this is an estimate
+            usage.huge_bytes += std::min(kilobytes * 1024, overlap);
+        }
+    }
+
+    usage.huge_bytes = std::min(usage.huge_bytes, usage.bytes);
+    return usage;
+}
+
+auto describe_huge_pages(const HugePageUsage& usage) -> std::string
+{
+    constexpr double MiB = 1024.0 * 1024.0;
+
+    if (usage.huge_bytes == 0) {
+        return fmt::format("none of {:.1f} MiB on huge pages", static_cast<double>(usage.bytes) / MiB);
+    }
+    return fmt::format("{:.1f} of {:.1f} MiB on {} huge pages",
+        static_cast<double>(usage.huge_bytes) / MiB,
+        static_cast<double>(usage.bytes) / MiB,
+        usage.explicit_pages ? "explicit" : "transparent");
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <vector>
+
+/// The size of the huge pages that `huge_page_allocate` asks for
+constexpr size_t HugePageSize = size_t{2} << 20;
+
+/// Allocates `bytes` bytes, backed by huge pages where the system allows it.
+///
+/// Allocations of at least half of a huge page are rounded up to whole huge
+/// pages and mapped on their own: explicit huge pages (`MAP_HUGETLB`) if any
+/// are reserved, otherwise normal pages aligned to a huge page and marked for
+/// transparent huge pages (`MADV_HUGEPAGE`). The kernel then backs them with
+/// huge pages when they are first touched, if it can. Smaller allocations come
+/// from `operator new`.
+/// @returns the memory, zeroed if it was mapped, or nullptr if there is none
+[[nodiscard]]
+auto huge_page_allocate(const size_t bytes) -> void*;
+
+/// Frees memory from `huge_page_allocate(bytes)`
+auto huge_page_free(void* data, const size_t bytes) -> void;
+
+/// An allocator that puts large arrays on huge pages, so that jumping around
+/// them (like the rays of the visibility kernels do) misses the TLB less often
+template<typename T>
+struct huge_page_allocator {
+    using value_type = T;
+
+    constexpr huge_page_allocator() noexcept = default;
+    template<typename U>
+    constexpr huge_page_allocator(const huge_page_allocator<U>&) noexcept {}
+
+    [[nodiscard]] auto allocate(const size_t n) -> T*
+    {
+        auto* data = huge_page_allocate(n * sizeof(T));
+        if (data == nullptr) { throw std::bad_alloc(); }
+        return static_cast<T*>(data);
+    }
+
+    auto deallocate(T* data, const size_t n) noexcept -> void { huge_page_free(data, n * sizeof(T)); }
+
+    template<typename U>
+    constexpr auto operator==(const huge_page_allocator<U>&) const noexcept -> bool { return true; }
+    template<typename U>
+    constexpr auto operator!=(const huge_page_allocator<U>&) const noexcept -> bool { return false; }
+};
+
+/// A `std::vector` on huge pages
+template<typename T>
+using huge_vector = std::vector<T, huge_page_allocator<T>>;
+
+/// How much of a range of memory is on huge pages
+struct HugePageUsage {
+    /// The size of the range
+    size_t bytes = 0;
+    /// The bytes of the range on huge pages, explicit or transparent
+    size_t huge_bytes = 0;
+    /// Whether those are explicit (`MAP_HUGETLB`) huge pages
+    bool explicit_pages = false;
+};
+
+/// @returns how much of `[data, data + bytes)` is on huge pages right now,
+///          according to `/proc/self/smaps`. Only pages that were touched
+///          count, and nothing does where the file doesn't exist.
+[[nodiscard]]
+auto huge_page_usage(const void* data, const size_t bytes) -> HugePageUsage;
+
+/// @returns `usage` for the run's report, like "12.0 of 13.7 MiB on
+///          transparent huge pages"
+[[nodiscard]]
+auto describe_huge_pages(const HugePageUsage& usage) -> std::string;
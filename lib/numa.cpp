@@ -0,0 +1,214 @@
+#include "numa.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    /// The node the calling thread was pinned to
+    thread_local size_t pinned_node = 0;
+
+    /// @returns the first line of `path`, or nothing if it can't be read
+    auto read_line(const std::filesystem::path& path) -> std::string
+    {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    /// @returns `value` as a number, or nothing if it isn't one
+    auto parse_number(const std::string_view value, size_t& number) -> bool
+    {
+        const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+        return error == std::errc{} && end == value.data() + value.size();
+    }
+}
+
+auto parse_cpu_list(const std::string_view list) -> std::vector<size_t>
+{
+    std::vector<size_t> cpus;
+
+    size_t begin = 0;
+    while (begin < list.size()) {
+        const size_t comma = std::min(list.find(',', begin), list.size());
+        const auto range = list.substr(begin, comma - begin);
+        begin = comma + 1;
+
+        const size_t dash = range.find('-');
+        size_t first = 0;
+        size_t last = 0;
+        if (dash == std::string_view::npos) {
+            if (!parse_number(range, first)) { return {}; }
+            last = first;
+        } else if (!parse_number(range.substr(0, dash), first) || !parse_number(range.substr(dash + 1), last) || last < first) {
+            return {};
+        }
+
+        for (size_t cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+auto format_cpu_list(std::vector<size_t> cpus) -> std::string
+{
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+
+    std::string list;
+    for (size_t i = 0; i < cpus.size();) {
+        // The run of consecutive CPUs starting at `i`
+        size_t end = i + 1;
+        while (end < cpus.size() && cpus[end] == cpus[end - 1] + 1) { ++end; }
+
+        if (!list.empty()) { list += ','; }
+        list += std::to_string(cpus[i]);
+        if (end - i > 1) { list += '-' + std::to_string(cpus[end - 1]); }
+        i = end;
+    }
+    return list;
+}
+
+auto read_numa_topology() -> NumaTopology
+{
+    namespace fs = std::filesystem;
+
+    // Every `node<N>` directory lists the CPUs of node N
+    std::vector<std::pair<size_t, std::vector<size_t>>> nodes;
+    std::error_code error;
+    for (const auto& entry : fs::directory_iterator("/sys/devices/system/node", error)) {
+        const auto name = entry.path().filename().string();
+        size_t node = 0;
+        if (name.rfind("node", 0) != 0 || !parse_number(std::string_view(name).substr(4), node)) { continue; }
+
+        auto cpus = parse_cpu_list(read_line(entry.path() / "cpulist"));
+        if (!cpus.empty()) { nodes.emplace_back(node, std::move(cpus)); }
+    }
+    std::sort(nodes.begin(), nodes.end());
+
+    NumaTopology topology;
+    for (auto& [node, cpus] : nodes) {
+        topology.node_cpus.push_back(std::move(cpus));
+    }
+
+    // Otherwise it's all one node
+    if (topology.node_cpus.empty()) {
+        auto cpus = parse_cpu_list(read_line("/sys/devices/system/cpu/online"));
+        if (cpus.empty()) {
+            for (size_t cpu = 0; cpu < std::max<size_t>(std::thread::hardware_concurrency(), 1); ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        topology.node_cpus.push_back(std::move(cpus));
+    }
+
+    return topology;
+}
+
+auto place_threads(const NumaTopology& topology, const size_t num_threads) -> NumaPlacement
+{
+    NumaPlacement placement;
+    if (topology.node_cpus.empty() || num_threads == 0) { return placement; }
+
+    const size_t num_nodes = std::min(topology.node_cpus.size(), num_threads);
+    placement.num_nodes = num_nodes;
+
+    for (size_t thread = 0; thread < num_threads; ++thread) {
+        // Thread blocks of (almost) the same size on every node
+        const size_t node = thread * num_nodes / num_threads;
+        const size_t first_thread = (node * num_threads + num_nodes - 1) / num_nodes;
+        const auto& cpus = topology.node_cpus[node];
+
+        placement.thread_node.push_back(node);
+        placement.thread_cpu.push_back(cpus[(thread - first_thread) % cpus.size()]);
+    }
+
+    return placement;
+}
+
+auto pin_thread(const size_t cpu, const size_t node) -> bool
+{
+    pinned_node = node;
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    static_cast<void>(cpu);
+    return false;
+#endif
+}
+
+auto thread_cpus() -> std::vector<size_t>
+{
+    std::vector<size_t> cpus;
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) { return cpus; }
+    for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) { cpus.push_back(cpu); }
+    }
+#endif
+
+    return cpus;
+}
+
+auto unpin_thread(const std::vector<size_t>& cpus) -> bool
+{
+    pinned_node = 0;
+    if (cpus.empty()) { return false; }
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const size_t cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+auto current_numa_node() -> size_t
+{
+    return pinned_node;
+}
+
+auto release_pages(void* data, const size_t bytes) -> size_t
+{
+#ifdef __linux__
+    const auto page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const auto begin = reinterpret_cast<uintptr_t>(data);
+
+    // Only the pages that are completely inside of the range
+    const uintptr_t first = (begin + page - 1) / page * page;
+    const uintptr_t last = (begin + bytes) / page * page;
+    if (last <= first) { return 0; }
+
+    if (madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED) != 0) { return 0; }
+    return last - first;
+#else
+    static_cast<void>(data);
+    static_cast<void>(bytes);
+    return 0;
+#endif
+}
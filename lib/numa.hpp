@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// The CPUs of every NUMA node, as Linux lists them in `/sys`
+struct NumaTopology {
+    /// The CPUs of every node, in increasing order. A machine without the
+    /// node entries is one node with every online CPU.
+    std::vector<std::vector<size_t>> node_cpus;
+};
+
+/// Where every thread of a NUMA aware run goes
+struct NumaPlacement {
+    /// The CPU of every thread
+    std::vector<size_t> thread_cpu;
+    /// The node of every thread
+    std::vector<size_t> thread_node;
+    /// The number of nodes with at least one thread
+    size_t num_nodes = 0;
+};
+
+/// @returns the CPUs of a Linux CPU list like `0-3,8,10-11`, or none if the
+///          list is invalid
+[[nodiscard]]
+auto parse_cpu_list(const std::string_view list) -> std::vector<size_t>;
+
+/// @returns `cpus` as a Linux CPU list, the reverse of `parse_cpu_list`
+[[nodiscard]]
+auto format_cpu_list(std::vector<size_t> cpus) -> std::string;
+
+/// @returns the NUMA nodes of this machine and their CPUs, read from
+///          `/sys/devices/system/node`
+[[nodiscard]]
+auto read_numa_topology() -> NumaTopology;
+
+/// Places `num_threads` threads on the nodes of `topology`, in contiguous
+/// blocks: the first threads go to the first node, the next ones to the
+/// second node, and so on, as evenly as the numbers allow. Work that is
+/// handed to the threads in contiguous blocks (like Morton ordered tiles) is
+/// then close together on every node. The threads of a node take its CPUs in
+/// order, and start over if there are more threads than CPUs.
+[[nodiscard]]
+auto place_threads(const NumaTopology& topology, const size_t num_threads) -> NumaPlacement;
+
+/// Pins the calling thread to `cpu` and remembers `node` for
+/// `current_numa_node`. Does nothing but remember the node where thread
+/// affinity isn't supported.
+/// @returns false if the thread couldn't be pinned
+auto pin_thread(const size_t cpu, const size_t node) -> bool;
+
+/// @returns the CPUs that the calling thread may run on, to give back to
+///          `unpin_thread` after pinning it. None where thread affinity
+///          isn't supported.
+[[nodiscard]]
+auto thread_cpus() -> std::vector<size_t>;
+
+/// Lets the calling thread run on `cpus` again (from `thread_cpus`) and
+/// forgets the node it was pinned to. Only forgets the node if `cpus` is
+/// empty.
+/// @returns false if the thread's CPUs couldn't be set
+auto unpin_thread(const std::vector<size_t>& cpus) -> bool;
+
+/// @returns the node that the calling thread was pinned to, 0 if it wasn't
+[[nodiscard]]
+auto current_numa_node() -> size_t;
+
+/// Gives the whole pages of `[data, data + bytes)` back to the system. Their
+/// contents are lost, and the first write to each of them allocates it again
+/// on the NUMA node of the writing thread (first touch). Only for anonymous
+/// memory from the heap, like the data of a `std::vector`.
+/// @returns the number of bytes that were given back
+auto release_pages(void* data, const size_t bytes) -> size_t;
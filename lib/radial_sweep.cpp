@@ -0,0 +1,91 @@
+#include "radial_sweep.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    /// A direction from the observer's center, in half cells so that every
+    /// corner and center is a pair of integers
+    struct Direction {
+        int64_t x;
+        int64_t y;
+
+        /// 0 for angles in `[0, pi)`, 1 for `[pi, 2 pi)`
+        [[nodiscard]] auto half() const -> int { return (y < 0 || (y == 0 && x < 0)) ? 1 : 0; }
+    };
+
+    /// @returns -1, 0 or 1 if the angle of `a` is smaller, equal or larger than
+    ///          the angle of `b`, both in `[0, 2 pi)`. Exact, so cells that
+    ///          touch a line of sight at a corner are always found.
+    auto compare_angles(const Direction a, const Direction b) -> int
+    {
+        if (a.half() != b.half()) { return a.half() < b.half() ? -1 : 1; }
+
+        const int64_t cross = a.x * b.y - a.y * b.x;
+        return cross > 0 ? -1 : (cross < 0 ? 1 : 0);
+    }
+}
+
+SweepStencil::SweepStencil(const int radius) : radius_(radius)
+{
+    const int64_t radius_squared = static_cast<int64_t>(radius) * radius;
+
+    for (int32_t dy = -radius; dy <= radius; ++dy) {
+        for (int32_t dx = -radius; dx <= radius; ++dx) {
+            const int64_t dist_squared = static_cast<int64_t>(dx) * dx + static_cast<int64_t>(dy) * dy;
+            if (dist_squared == 0 || dist_squared > radius_squared) { continue; }
+
+            cells_.push_back({dx, dy, 1.0f / std::sqrt(static_cast<float>(dist_squared)), 0});
+        }
+    }
+
+    // Closest first, and count the cells in front of every distance
+    const auto dist_squared = [](const Cell& cell) {
+        return static_cast<int64_t>(cell.dx) * cell.dx + static_cast<int64_t>(cell.dy) * cell.dy;
+    };
+    std::stable_sort(cells_.begin(), cells_.end(), [&](const Cell& a, const Cell& b) {
+        return dist_squared(a) < dist_squared(b);
+    });
+    for (size_t i = 1; i < cells_.size(); ++i) {
+        cells_[i].closer = dist_squared(cells_[i]) == dist_squared(cells_[i - 1]) ? cells_[i - 1].closer : static_cast<uint32_t>(i);
+    }
+
+    // Every event with the direction it happens at
+    std::vector<std::pair<Direction, Event>> events;
+    events.reserve(3 * cells_.size());
+
+    for (size_t i = 0; i < cells_.size(); ++i) {
+        const auto& cell = cells_[i];
+        const auto index = static_cast<uint32_t>(i);
+        const Direction center{2 * int64_t{cell.dx}, 2 * int64_t{cell.dy}};
+
+        // The sweep starts inside of the cells on the positive x axis, leaves
+        // them at their upper left corner and enters them again at their
+        // lower left one
+        if (cell.dy == 0 && cell.dx > 0) {
+            initially_active_.push_back(index);
+            events.push_back({center, {index, EventKind::center}});
+            events.push_back({Direction{center.x - 1, 1}, {index, EventKind::exit}});
+            events.push_back({Direction{center.x - 1, -1}, {index, EventKind::enter}});
+            continue;
+        }
+
+        const Direction corners[] = {
+            {center.x - 1, center.y - 1}, {center.x + 1, center.y - 1},
+            {center.x - 1, center.y + 1}, {center.x + 1, center.y + 1}};
+
+        const auto by_angle = [](const Direction a, const Direction b) { return compare_angles(a, b) < 0; };
+        events.push_back({*std::min_element(std::begin(corners), std::end(corners), by_angle), {index, EventKind::enter}});
+        events.push_back({center, {index, EventKind::center}});
+        events.push_back({*std::max_element(std::begin(corners), std::end(corners), by_angle), {index, EventKind::exit}});
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const auto& a, const auto& b) {
+        const int order = compare_angles(a.first, b.first);
+        return order != 0 ? order < 0 : a.second.kind < b.second.kind;
+    });
+
+    events_.reserve(events.size());
+    for (const auto& [direction, event] : events) {
+        events_.push_back(event);
+    }
+}
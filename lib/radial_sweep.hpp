@@ -0,0 +1,197 @@
+#pragma once
+
+#include "core.hpp"
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/// The geometry of an exact angular sweep around an observer (Van Kreveld's
+/// radial sweep), for every cell within `radius` of it.
+///
+/// Every cell is a unit square with its height at the center. A cell is
+/// visible if its slope (`height_diff / distance` to its center) is higher
+/// than the slope of every strictly closer cell whose square the line of
+/// sight to its center touches. Sweeping a ray around the observer, a cell
+/// is *active* between the angles of its first and last corner, and the
+/// active cells closer than a cell are exactly the ones that can block it.
+///
+/// None of this depends on where the observer is, so the cells (sorted by
+/// distance) and the events (sorted by angle) are built once per radius.
+class SweepStencil {
+public:
+    struct Cell {
+        int32_t dx;
+        int32_t dy;
+        /// `1 / sqrt(dx * dx + dy * dy)`
+        float inv_dist;
+        /// The number of cells that are strictly closer to the observer,
+        /// which are the first `closer` of `cells()`
+        uint32_t closer;
+    };
+
+    enum class EventKind : uint8_t {
+        /// The sweep reaches the first corner of the cell
+        enter,
+        /// The sweep reaches the center of the cell
+        center,
+        /// The sweep leaves the last corner of the cell
+        exit,
+    };
+
+    struct Event {
+        /// The index of the cell in `cells()`
+        uint32_t cell;
+        EventKind kind;
+    };
+
+    /// @param radius the distance (in pixels) to the center of the farthest cells
+    explicit SweepStencil(const int radius);
+
+    /// @returns the radius the stencil was built for
+    [[nodiscard]] auto radius() const noexcept -> int { return radius_; }
+
+    /// @returns every cell within the radius except the observer's own, closest first
+    [[nodiscard]] auto cells() const noexcept -> const std::vector<Cell>& { return cells_; }
+
+    /// @returns the events of a sweep starting at the positive x axis, in the order
+    ///          they happen (cells entering before centers, centers before cells exiting
+    ///          at the same angle)
+    [[nodiscard]] auto events() const noexcept -> const std::vector<Event>& { return events_; }
+
+    /// @returns the cells that the sweep starts inside of (the ones on the positive x
+    ///          axis), which are entered again at the end of the sweep
+    [[nodiscard]] auto initially_active() const noexcept -> const std::vector<uint32_t>& { return initially_active_; }
+
+private:
+    int radius_;
+    std::vector<Cell> cells_;
+    std::vector<Event> events_;
+    std::vector<uint32_t> initially_active_;
+};
+
+/// Sweeps a `SweepStencil` around observers, keeping the slopes of the active
+/// cells in a max segment tree indexed by distance. Each observer takes
+/// `O(n log n)` for the `n` cells in its radius. Holds scratch space, so use
+/// one per thread.
+class RadialSweep {
+public:
+    explicit RadialSweep(const SweepStencil& stencil)
+        : stencil_(&stencil), size_(stencil.cells().size()),
+          tree_(2 * stencil.cells().size(), -std::numeric_limits<float>::infinity())
+    {}
+
+    /// Calls `visit(x, y)` for every cell visible from `(x, y)`, except the observer's own
+    /// @param heights the height map, indexed `heights(y, x)` (row-major like the input files)
+    template<typename Visit>
+    auto visible_cells(const size_t x, const size_t y, const mat_2d_i16 heights, Visit&& visit) -> void
+    {
+        const auto radius = static_cast<size_t>(stencil_->radius());
+        const bool interior = x >= radius && x + radius < heights.extent(1) && y >= radius && y + radius < heights.extent(0);
+
+        if (interior) {
+            sweep<false>(x, y, heights, visit);
+        } else {
+            sweep<true>(x, y, heights, visit);
+        }
+    }
+
+    /// @returns the number of cells visible from `(x, y)`, including its own
+    auto count_visible(const size_t x, const size_t y, const mat_2d_i16 heights) -> unsigned int
+    {
+        unsigned int visible_count = 1;
+        visible_cells(x, y, heights, [&](size_t, size_t) { ++visible_count; });
+        return visible_count;
+    }
+
+private:
+    template<bool CheckBounds, typename Visit>
+    auto sweep(const size_t x, const size_t y, const mat_2d_i16 heights, Visit& visit) -> void
+    {
+        const auto& cells = stencil_->cells();
+        const auto width = static_cast<int64_t>(heights.extent(1));
+        const auto height = static_cast<int64_t>(heights.extent(0));
+        const auto current_height = static_cast<float>(static_cast<uint16_t>(heights(y, x)));
+
+        // Cells off the map are never inserted, so they neither block nor get
+        // counted. Observers at least a radius away from the edges can't
+        // reach any.
+        const auto on_map = [&](const SweepStencil::Cell& cell) {
+            if constexpr (!CheckBounds) { return true; }
+            const int64_t cell_x = static_cast<int64_t>(x) + cell.dx;
+            const int64_t cell_y = static_cast<int64_t>(y) + cell.dy;
+            return cell_x >= 0 && cell_x < width && cell_y >= 0 && cell_y < height;
+        };
+        const auto slope = [&](const SweepStencil::Cell& cell) {
+            const auto point_height = static_cast<uint16_t>(heights(
+                static_cast<size_t>(static_cast<int64_t>(y) + cell.dy), static_cast<size_t>(static_cast<int64_t>(x) + cell.dx)));
+            return (static_cast<float>(point_height) - current_height) * cell.inv_dist;
+        };
+
+        for (const uint32_t index : stencil_->initially_active()) {
+            if (on_map(cells[index])) { insert(index, slope(cells[index])); }
+        }
+
+        for (const auto& event : stencil_->events()) {
+            const auto& cell = cells[event.cell];
+
+            switch (event.kind) {
+                case SweepStencil::EventKind::enter:
+                    if (on_map(cell)) { insert(event.cell, slope(cell)); }
+                    break;
+                case SweepStencil::EventKind::center:
+                    // The cell's own slope is in the tree (if it is on the map)
+                    if (on_map(cell) && tree_[size_ + event.cell] > max_before(cell.closer)) {
+                        visit(static_cast<size_t>(static_cast<int64_t>(x) + cell.dx),
+                              static_cast<size_t>(static_cast<int64_t>(y) + cell.dy));
+                    }
+                    break;
+                case SweepStencil::EventKind::exit:
+                    remove(event.cell);
+                    break;
+            }
+        }
+
+        // Leave the tree empty for the next observer
+        for (const uint32_t index : stencil_->initially_active()) {
+            remove(index);
+        }
+    }
+
+    auto insert(const size_t index, const float slope) -> void
+    {
+        size_t node = size_ + index;
+        tree_[node] = slope;
+
+        // Stop as soon as an ancestor already has a higher slope
+        for (node >>= 1; node > 0 && tree_[node] < slope; node >>= 1) {
+            tree_[node] = slope;
+        }
+    }
+
+    auto remove(const size_t index) -> void
+    {
+        size_t node = size_ + index;
+        tree_[node] = -std::numeric_limits<float>::infinity();
+
+        // Recompute every ancestor, stopping early mispredicts more than it saves
+        for (node >>= 1; node > 0; node >>= 1) {
+            tree_[node] = std::max(tree_[2 * node], tree_[2 * node + 1]);
+        }
+    }
+
+    /// @returns the highest slope of the cells `[0, end)`
+    [[nodiscard]] auto max_before(size_t end) const -> float
+    {
+        float max_slope = -std::numeric_limits<float>::infinity();
+        for (size_t begin = size_, end_node = size_ + end; begin < end_node; begin >>= 1, end_node >>= 1) {
+            if (begin & 1) { max_slope = std::max(max_slope, tree_[begin++]); }
+            if (end_node & 1) { max_slope = std::max(max_slope, tree_[--end_node]); }
+        }
+        return max_slope;
+    }
+
+    const SweepStencil* stencil_;
+    size_t size_;
+    /// Leaves `[size_, 2 * size_)` are the cells, in the order of `cells()`
+    std::vector<float> tree_;
+};
@@ -1,80 +1,235 @@
-#include <vector>
+#pragma once
+
+#include "ray_stencil.hpp"
+#include <span.hpp>
+#include <algorithm>
 #include <cmath>
 #include <limits>
-#include <cstdint> // For int16_t, uint64_t
-#include <utility> // For std::pair
-
-static constexpr inline auto single_pixel_visiblity(
-    const size_t x,                        
-    const size_t y,                        
-    const size_t width,                    
-    const size_t height,                   
-    const int radius,                      
-    const int radius_squared,              
-    const std::vector<int16_t>& height_map,
-    const std::vector<std::pair<float, float>>& ray_directions) -> int 
+#include <cstdint> // For int16_t, uint16_t
+#include <utility>
+
+/// The rectangle `[x_begin, x_end) x [y_begin, y_end)` of observers whose rays
+/// can never leave the map. Observers inside of it can skip the bounds checks.
+struct InteriorRegion {
+    size_t x_begin;
+    size_t x_end;
+    size_t y_begin;
+    size_t y_end;
+
+    [[nodiscard]] auto contains_row(const size_t y) const noexcept -> bool { return y >= y_begin && y < y_end; }
+    [[nodiscard]] auto contains(const size_t x, const size_t y) const noexcept -> bool
+    {
+        return contains_row(y) && x >= x_begin && x < x_end;
+    }
+};
+
+/// @returns the observers of a `width` by `height` map that `stencil` can't cast a ray out of
+/// @param stencil a `RayStencil` or `StaticStencil`
+template<typename Stencil>
+[[nodiscard]]
+constexpr auto interior_region(const Stencil& stencil, const size_t width, const size_t height) -> InteriorRegion
+{
+    // Shrinks [0, size) by the reach of the stencil on either side
+    const auto shrink = [](const size_t size, const int32_t low, const int32_t high) {
+        const auto begin = std::min(size, static_cast<size_t>(-low));
+        const auto end = size - std::min(size, static_cast<size_t>(high));
+        return std::pair{begin, std::max(begin, end)};
+    };
+
+    const auto [x_begin, x_end] = shrink(width, stencil.min_dx(), stencil.max_dx());
+    const auto [y_begin, y_end] = shrink(height, stencil.min_dy(), stencil.max_dy());
+
+    return {x_begin, x_end, y_begin, y_end};
+}
+
+/// How the kernels compare the vertical angles of the cells along a ray
+enum class SlopeMode {
+    /// `height_diff * inv_dist` as a `float`
+    floating,
+    /// The exact product `height_diff * inv_dist` as a 64-bit integer. The
+    /// horizon is the largest exact slope so far, and a new maximum is only
+    /// counted if it still beats the horizon after both are rounded like the
+    /// `float` multiply. Gives the same counts as `floating` without any
+    /// floating point in the inner loop.
+    fixed,
+};
+
+namespace detail {
+
+/// @returns `value` rounded to 24 significant bits (to nearest, ties to
+///          even), exactly like the result of a `float` multiply
+inline auto round_slope(const int64_t value) -> int64_t
+{
+    // Branch free, this runs for every step of every ray
+    const int64_t sign = value >> 63;
+    const auto magnitude = static_cast<uint64_t>((value ^ sign) - sign);
+
+    // The number of bits past the 24 a float can hold
+    const int bits = 64 - __builtin_clzll(magnitude | 1);
+    const int excess = std::max(bits - 24, 0);
+
+    // Adding just under half a unit (plus one if the kept part is odd) and
+    // truncating rounds to nearest with ties to even. Nothing to round if
+    // there is no excess.
+    const uint64_t unit = uint64_t{1} << excess;
+    const uint64_t round_bias = ((unit >> 1) - 1 + ((magnitude >> excess) & 1)) & (uint64_t{0} - static_cast<uint64_t>(excess > 0));
+    const auto rounded = static_cast<int64_t>(((magnitude + round_bias) >> excess) << excess);
+
+    return (rounded ^ sign) - sign;
+}
+
+template<bool CheckBounds, SlopeMode Slope>
+inline auto pixel_visibility(
+    const size_t x,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil) -> unsigned int
 {
     // Get the height of the current pixel
-    const unsigned short current_height = height_map[y * width + x];
+    const auto current_height = static_cast<uint16_t>(height_map[y * width + x]);
 
     // Start the count at this cell as 1 (the pixel itself is always visible)
     unsigned int visible_count = 1;
 
+    const int32_t* const offsets_x = stencil.dx().data();
+    const int32_t* const offsets_y = stencil.dy().data();
+    const float* const inv_dist = stencil.inv_dist().data();
+    const int64_t* const slope_scale = stencil.slope_scale().data();
+
     // Cast rays in different directions
-    for (const auto& [dx, dy] : ray_directions) {
-        // Use a more efficient ray casting approach
-        // Start from the center and move outward
-        const int max_steps = radius; // Maximum steps roughly corresponds to radius
+    for (size_t ray = 0; ray < stencil.num_rays(); ++ray) {
         float max_angle_seen = -std::numeric_limits<float>::infinity();
+        int64_t max_slope_seen = std::numeric_limits<int64_t>::min();
+        int64_t max_slope_rounded = std::numeric_limits<int64_t>::min();
 
-        // Step size for ray traversal
-        // Avoid division by zero if dx and dy are both zero (though unlikely with precalculated directions)
-        const float ray_length = std::sqrt(dx * dx + dy * dy);
-        const float step_x = dx / ray_length;
-        const float step_y = dy / ray_length;
-
-        float curr_x_f = static_cast<float>(x) + 0.5f;  // Start at center of pixel
-        float curr_y_f = static_cast<float>(y) + 0.5f;
-
-        for (int step = 1; step <= max_steps; ++step) {
-            // Move along the ray by one unit distance
-            curr_x_f += step_x;
-            curr_y_f += step_y;
-
-            // Round to nearest pixel coordinates
-            const int curr_x = static_cast<int>(std::round(curr_x_f));
-            const int curr_y = static_cast<int>(std::round(curr_y_f));
-
-            // --- Bounds and Radius Checks ---
-            // Check bounds first (more likely to fail early for edge pixels)
-            if (curr_x < 0 || curr_x >= static_cast<int>(width) ||
-                curr_y < 0 || curr_y >= static_cast<int>(height)) {
-                break; // Ray went out of bounds
-            }
+        // Every step of the ray is already inside of the radius, so only the
+        // map bounds need to be checked (and not even those in the interior)
+        for (size_t step = stencil.ray_begin(ray); step < stencil.ray_end(ray); ++step) {
+            const int curr_x = static_cast<int>(x) + offsets_x[step];
+            const int curr_y = static_cast<int>(y) + offsets_y[step];
 
-            // Check if we've gone too far (outside the radius)
-            // Use squared distance for efficiency
-            const int dist_squared = (curr_x - static_cast<int>(x)) * (curr_x - static_cast<int>(x)) +
-                                     (curr_y - static_cast<int>(y)) * (curr_y - static_cast<int>(y));
-            if (dist_squared > radius_squared) {
-                break; // Ray went beyond the specified radius
+            // Check bounds (more likely to fail early for edge pixels)
+            if constexpr (CheckBounds) {
+                if (curr_x < 0 || curr_x >= static_cast<int>(width) ||
+                    curr_y < 0 || curr_y >= static_cast<int>(height)) {
+                    break; // Ray went out of bounds
+                }
             }
 
             // Get height at the current position on the ray
-            const unsigned short point_height = height_map[curr_y * width + curr_x];
+            const auto index = static_cast<size_t>(curr_y) * width + static_cast<size_t>(curr_x);
+            const auto point_height = static_cast<uint16_t>(height_map[index]);
 
             // Calculate the vertical angle to this point
-            // Use the precise distance for angle calculation
-            const float distance = std::sqrt(static_cast<float>(dist_squared));
-            const float height_diff = static_cast<float>(point_height) - static_cast<float>(current_height);
-            const float angle = height_diff / distance;
-            
-            if (angle > max_angle_seen) {
-                max_angle_seen = angle;
-                visible_count++;
+            if constexpr (Slope == SlopeMode::fixed) {
+                const int64_t height_diff = static_cast<int64_t>(point_height) - static_cast<int64_t>(current_height);
+                const int64_t slope = height_diff * slope_scale[step];
+
+                // Rounding never changes the order of two slopes (only makes
+                // some of them equal), so only a new exact maximum can be
+                // visible. Branch free, the integer ops are cheaper than the
+                // mispredictions.
+                const bool higher = slope > max_slope_seen;
+                const int64_t rounded = round_slope(slope);
+                visible_count += (higher && rounded > max_slope_rounded) ? 1 : 0;
+                max_slope_seen = higher ? slope : max_slope_seen;
+                max_slope_rounded = higher ? rounded : max_slope_rounded;
+            } else {
+                const float angle = (static_cast<float>(point_height) - static_cast<float>(current_height)) * inv_dist[step];
+
+                if (angle > max_angle_seen) {
+                    max_angle_seen = angle;
+                    visible_count++;
+                }
             }
         }
     }
 
     return visible_count;
-}
\ No newline at end of file
+}
+
+template<SlopeMode Slope>
+inline auto row_visibility(
+    const size_t y,
+    const size_t x_begin,
+    const size_t x_end,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    const InteriorRegion& interior,
+    unsigned int* output) -> void
+{
+    // Rows near the top and bottom are border pixels all the way through
+    const size_t inner_begin = interior.contains_row(y) ? std::clamp(interior.x_begin, x_begin, x_end) : x_end;
+    const size_t inner_end = interior.contains_row(y) ? std::clamp(interior.x_end, inner_begin, x_end) : x_end;
+
+    size_t x = x_begin;
+    for (; x < inner_begin; ++x) {
+        output[x - x_begin] = pixel_visibility<true, Slope>(x, y, width, height, height_map, stencil);
+    }
+    for (; x < inner_end; ++x) {
+        output[x - x_begin] = pixel_visibility<false, Slope>(x, y, width, height, height_map, stencil);
+    }
+    for (; x < x_end; ++x) {
+        output[x - x_begin] = pixel_visibility<true, Slope>(x, y, width, height, height_map, stencil);
+    }
+}
+
+} // namespace detail
+
+/// Counts the cells visible from `(x, y)`, stopping every ray at the map edge.
+static inline auto single_pixel_visiblity(
+    const size_t x,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    const SlopeMode slope = SlopeMode::floating) -> unsigned int
+{
+    return slope == SlopeMode::fixed
+        ? detail::pixel_visibility<true, SlopeMode::fixed>(x, y, width, height, height_map, stencil)
+        : detail::pixel_visibility<true, SlopeMode::floating>(x, y, width, height, height_map, stencil);
+}
+
+/// Same as `single_pixel_visiblity`, but without any bounds checks. `(x, y)`
+/// must be inside of `interior_region(stencil, width, height)`.
+static inline auto interior_pixel_visiblity(
+    const size_t x,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    const SlopeMode slope = SlopeMode::floating) -> unsigned int
+{
+    return slope == SlopeMode::fixed
+        ? detail::pixel_visibility<false, SlopeMode::fixed>(x, y, width, height, height_map, stencil)
+        : detail::pixel_visibility<false, SlopeMode::floating>(x, y, width, height, height_map, stencil);
+}
+
+/// Calculates the visibility of the pixels `[x_begin, x_end)` of row `y`,
+/// using the unchecked kernel for the ones inside of `interior`.
+/// @param output the output value of pixel `x_begin`, followed by the rest of the range
+/// @param slope how the vertical angles are compared
+static inline auto row_visibility(
+    const size_t y,
+    const size_t x_begin,
+    const size_t x_end,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    const InteriorRegion& interior,
+    unsigned int* output,
+    const SlopeMode slope = SlopeMode::floating) -> void
+{
+    if (slope == SlopeMode::fixed) {
+        detail::row_visibility<SlopeMode::fixed>(y, x_begin, x_end, width, height, height_map, stencil, interior, output);
+    } else {
+        detail::row_visibility<SlopeMode::floating>(y, x_begin, x_end, width, height, height_map, stencil, interior, output);
+    }
+}
@@ -0,0 +1,45 @@
+#include "ray_stencil.hpp"
+#include <algorithm>
+#include <cmath>
+
+RayStencil::RayStencil(const int radius, const int num_angles) : radius_(radius)
+{
+    // A ray never takes more than `radius` steps
+    const auto max_steps = static_cast<size_t>(std::max(radius, 0));
+    const auto num_rays = static_cast<size_t>(std::max(num_angles, 0));
+
+    dx_.reserve(num_rays * max_steps);
+    dy_.reserve(num_rays * max_steps);
+    inv_dist_.reserve(num_rays * max_steps);
+    ray_offsets_.reserve(num_rays + 1);
+    ray_offsets_.push_back(0);
+
+    for (size_t i = 0; i < num_rays; ++i) {
+        stencil_detail::walk_ray(radius, i, num_angles, [&](const int32_t dx, const int32_t dy, const float inv_dist) {
+            dx_.push_back(dx);
+            dy_.push_back(dy);
+            inv_dist_.push_back(inv_dist);
+            min_dx_ = std::min(min_dx_, dx);
+            max_dx_ = std::max(max_dx_, dx);
+            min_dy_ = std::min(min_dy_, dy);
+            max_dy_ = std::max(max_dy_, dy);
+        });
+
+        ray_offsets_.push_back(static_cast<uint32_t>(dx_.size()));
+    }
+
+    // Every inverse distance is `mantissa * 2^exponent` with a 24-bit mantissa
+    // (exactly the bits of the float). Scaling them all by the smallest power
+    // of two turns them into exact integers.
+    int min_exponent = 0;
+    for (const float inv_dist : inv_dist_) {
+        int exponent = 0;
+        std::frexp(inv_dist, &exponent);
+        min_exponent = std::min(min_exponent, exponent);
+    }
+
+    slope_scale_.reserve(inv_dist_.size());
+    for (const float inv_dist : inv_dist_) {
+        slope_scale_.push_back(static_cast<int64_t>(std::ldexp(static_cast<double>(inv_dist), 24 - min_exponent)));
+    }
+}
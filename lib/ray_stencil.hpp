@@ -0,0 +1,147 @@
+#pragma once
+
+#include "constexpr_math.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace stencil_detail {
+    /// Rounds to the nearest cell, rounding half-way cases up. This is what
+    /// `std::round` does for the (positive) absolute coordinates of an
+    /// observer inside the map.
+    constexpr auto to_cell(const float coordinate) -> int32_t
+    {
+        auto floor = static_cast<int32_t>(coordinate);
+        if (static_cast<float>(floor) > coordinate) { --floor; }
+        return floor + (coordinate - static_cast<float>(floor) >= 0.5f ? 1 : 0);
+    }
+
+    /// Walks ray number `ray` of `num_angles` evenly spaced rays, and calls
+    /// `visit(dx, dy, inv_dist)` for every cell it keeps. This is shared by
+    /// `RayStencil` and the compile time tables of `static_visibility.hpp`,
+    /// so both always contain exactly the same steps.
+    template<typename Visit>
+    constexpr auto walk_ray(const int radius, const size_t ray, const int num_angles, Visit&& visit) -> void
+    {
+        constexpr double pi = 3.14159265358979323846;
+
+        const int radius_squared = radius * radius;
+
+        // A ray never takes more than `radius` steps
+        const auto max_steps = static_cast<size_t>(radius > 0 ? radius : 0);
+
+        // The distance between each angle in radians
+        const double angle_step = 2 * pi / num_angles;
+        const double angle = static_cast<double>(ray) * angle_step;
+        const auto dx = static_cast<float>(constexpr_math::cos(angle) * radius);
+        const auto dy = static_cast<float>(constexpr_math::sin(angle) * radius);
+
+        // Move along the ray in steps of unit length
+        const float ray_length = constexpr_math::sqrt(dx * dx + dy * dy);
+        const float step_x = dx / ray_length;
+        const float step_y = dy / ray_length;
+
+        // Walk the ray exactly the way the original per-pixel loop did, starting
+        // at the center of the observer's pixel
+        float curr_x_f = 0.5f;
+        float curr_y_f = 0.5f;
+        int32_t last_x = 0;
+        int32_t last_y = 0;
+
+        for (size_t step = 1; step <= max_steps; ++step) {
+            curr_x_f += step_x;
+            curr_y_f += step_y;
+
+            const int32_t curr_x = to_cell(curr_x_f);
+            const int32_t curr_y = to_cell(curr_y_f);
+
+            // Stop at the first cell that is outside of the radius
+            const int32_t dist_squared = curr_x * curr_x + curr_y * curr_y;
+            if (dist_squared > radius_squared) {
+                break;
+            }
+
+            // Revisiting the previous cell gives the same angle as last time, so
+            // it can never be counted as visible. Skip it. This also skips the
+            // observer's own cell, which the walk can land on for the first step.
+            if (curr_x == last_x && curr_y == last_y) {
+                continue;
+            }
+            last_x = curr_x;
+            last_y = curr_y;
+
+            visit(curr_x, curr_y, 1.0f / constexpr_math::sqrt(static_cast<float>(dist_squared)));
+        }
+    }
+}
+
+/// Precomputed ray geometry for a fixed `(radius, num_angles)` pair.
+///
+/// Every observer casts exactly the same rays, so the cells that a ray visits
+/// only differ between observers by the observer's own position. This class
+/// walks each ray once (as if cast from the origin) and stores the integer
+/// cell offsets it visits, together with the inverse distance to each of
+/// those cells. The hot loop of the visibility kernels then reduces to a load,
+/// a subtract, a multiply and a compare per step.
+///
+/// The steps of all rays are stored back to back (structure of arrays), and
+/// the steps of ray `r` are the half-open range `[ray_begin(r), ray_end(r))`.
+class RayStencil {
+public:
+    /// Builds the stencil.
+    /// @param radius the maximum distance (in pixels) that a ray travels
+    /// @param num_angles the number of evenly spaced rays to cast
+    RayStencil(const int radius, const int num_angles);
+
+    /// @returns the radius the stencil was built for
+    [[nodiscard]] auto radius() const noexcept -> int { return radius_; }
+
+    /// @returns the number of rays in the stencil
+    [[nodiscard]] auto num_rays() const noexcept -> size_t { return ray_offsets_.size() - 1; }
+
+    /// @returns the total number of steps over all rays
+    [[nodiscard]] auto num_steps() const noexcept -> size_t { return dx_.size(); }
+
+    /// @returns the index of the first step of `ray`
+    [[nodiscard]] auto ray_begin(const size_t ray) const noexcept -> size_t { return ray_offsets_[ray]; }
+
+    /// @returns one past the index of the last step of `ray`
+    [[nodiscard]] auto ray_end(const size_t ray) const noexcept -> size_t { return ray_offsets_[ray + 1]; }
+
+    /// @returns the x offset of every step
+    [[nodiscard]] auto dx() const noexcept -> const std::vector<int32_t>& { return dx_; }
+
+    /// @returns the y offset of every step
+    [[nodiscard]] auto dy() const noexcept -> const std::vector<int32_t>& { return dy_; }
+
+    /// @returns `1 / sqrt(dx * dx + dy * dy)` for every step
+    [[nodiscard]] auto inv_dist() const noexcept -> const std::vector<float>& { return inv_dist_; }
+
+    /// @returns `inv_dist()` for every step as an exact integer, scaled by the
+    ///          same power of two for the whole stencil (`SlopeMode::fixed`)
+    [[nodiscard]] auto slope_scale() const noexcept -> const std::vector<int64_t>& { return slope_scale_; }
+
+    /// @returns the step offsets of each ray, `num_rays() + 1` entries long
+    [[nodiscard]] auto ray_offsets() const noexcept -> const std::vector<uint32_t>& { return ray_offsets_; }
+
+    /// @returns the smallest x offset of any step (zero or less)
+    [[nodiscard]] auto min_dx() const noexcept -> int32_t { return min_dx_; }
+    /// @returns the largest x offset of any step (zero or more)
+    [[nodiscard]] auto max_dx() const noexcept -> int32_t { return max_dx_; }
+    /// @returns the smallest y offset of any step (zero or less)
+    [[nodiscard]] auto min_dy() const noexcept -> int32_t { return min_dy_; }
+    /// @returns the largest y offset of any step (zero or more)
+    [[nodiscard]] auto max_dy() const noexcept -> int32_t { return max_dy_; }
+
+private:
+    int radius_;
+    int32_t min_dx_{0};
+    int32_t max_dx_{0};
+    int32_t min_dy_{0};
+    int32_t max_dy_{0};
+    std::vector<int32_t> dx_;
+    std::vector<int32_t> dy_;
+    std::vector<float> inv_dist_;
+    std::vector<int64_t> slope_scale_;
+    std::vector<uint32_t> ray_offsets_;
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "ray_casting.hpp"
+#include <span.hpp>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <utility>
+
+/// The ray tables of a `RayStencil`, generated at compile time for a fixed
+/// `(Radius, Angles)` pair. The steps are exactly the ones of
+/// `RayStencil(Radius, Angles)`, they are only stored in arrays whose sizes
+/// (and every ray's start and end) are known to the compiler.
+template<int Radius, int Angles>
+struct StaticStencil {
+    static_assert(Radius > 0 && Angles > 0, "the stencil needs a radius and at least one ray");
+
+    /// Upper bound on the number of steps, every ray takes at most `Radius`
+    static constexpr size_t capacity = static_cast<size_t>(Radius) * static_cast<size_t>(Angles);
+
+    std::array<uint32_t, static_cast<size_t>(Angles) + 1> ray_offsets{};
+    std::array<int32_t, capacity> dx{};
+    std::array<int32_t, capacity> dy{};
+    std::array<float, capacity> inv_dist{};
+
+    int32_t min_dx_{0};
+    int32_t max_dx_{0};
+    int32_t min_dy_{0};
+    int32_t max_dy_{0};
+
+    [[nodiscard]] constexpr auto min_dx() const noexcept -> int32_t { return min_dx_; }
+    [[nodiscard]] constexpr auto max_dx() const noexcept -> int32_t { return max_dx_; }
+    [[nodiscard]] constexpr auto min_dy() const noexcept -> int32_t { return min_dy_; }
+    [[nodiscard]] constexpr auto max_dy() const noexcept -> int32_t { return max_dy_; }
+};
+
+/// Builds the tables of a `StaticStencil`, meant to be evaluated at compile time
+template<int Radius, int Angles>
+[[nodiscard]]
+constexpr auto make_static_stencil() -> StaticStencil<Radius, Angles>
+{
+    StaticStencil<Radius, Angles> stencil{};
+    uint32_t steps = 0;
+
+    for (size_t ray = 0; ray < static_cast<size_t>(Angles); ++ray) {
+        stencil_detail::walk_ray(Radius, ray, Angles, [&](const int32_t dx, const int32_t dy, const float inv_dist) {
+            stencil.dx[steps] = dx;
+            stencil.dy[steps] = dy;
+            stencil.inv_dist[steps] = inv_dist;
+            stencil.min_dx_ = dx < stencil.min_dx_ ? dx : stencil.min_dx_;
+            stencil.max_dx_ = dx > stencil.max_dx_ ? dx : stencil.max_dx_;
+            stencil.min_dy_ = dy < stencil.min_dy_ ? dy : stencil.min_dy_;
+            stencil.max_dy_ = dy > stencil.max_dy_ ? dy : stencil.max_dy_;
+            ++steps;
+        });
+
+        stencil.ray_offsets[ray + 1] = steps;
+    }
+
+    return stencil;
+}
+
+/// The tables for `(Radius, Angles)`, one copy per configuration
+template<int Radius, int Angles>
+inline constexpr auto static_stencil = make_static_stencil<Radius, Angles>();
+
+namespace detail {
+
+/// Casts a single ray. Both ends of the ray are compile time constants, so
+/// the step loop has a fixed trip count.
+template<int Radius, int Angles, bool CheckBounds, size_t Ray>
+inline auto static_ray_visibility(
+    const int x,
+    const int y,
+    const int width,
+    const int height,
+    const int16_t* const height_map,
+    const float current_height) -> unsigned int
+{
+    constexpr auto& stencil = static_stencil<Radius, Angles>;
+    constexpr size_t begin = stencil.ray_offsets[Ray];
+    constexpr size_t end = stencil.ray_offsets[Ray + 1];
+
+    unsigned int visible_count = 0;
+    float max_angle_seen = -std::numeric_limits<float>::infinity();
+
+    for (size_t step = begin; step < end; ++step) {
+        const int curr_x = x + stencil.dx[step];
+        const int curr_y = y + stencil.dy[step];
+
+        if constexpr (CheckBounds) {
+            if (curr_x < 0 || curr_x >= width || curr_y < 0 || curr_y >= height) {
+                break; // Ray went out of bounds
+            }
+        }
+
+        // Get height at the current position on the ray
+        const auto index = static_cast<size_t>(curr_y) * static_cast<size_t>(width) + static_cast<size_t>(curr_x);
+        const auto point_height = static_cast<float>(static_cast<uint16_t>(height_map[index]));
+
+        // Calculate the vertical angle to this point
+        const float angle = (point_height - current_height) * stencil.inv_dist[step];
+
+        if (angle > max_angle_seen) {
+            max_angle_seen = angle;
+            visible_count++;
+        }
+    }
+
+    return visible_count;
+}
+
+template<int Radius, int Angles, bool CheckBounds, size_t... Rays>
+inline auto static_pixel_visibility(
+    const size_t x,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    std::index_sequence<Rays...>) -> unsigned int
+{
+    // Get the height of the current pixel
+    const auto current_height = static_cast<float>(static_cast<uint16_t>(height_map[y * width + x]));
+
+    // The pixel itself is always visible, plus whatever every ray sees
+    return 1 + (static_ray_visibility<Radius, Angles, CheckBounds, Rays>(
+        static_cast<int>(x), static_cast<int>(y), static_cast<int>(width), static_cast<int>(height),
+        height_map.data(), current_height) + ...);
+}
+
+} // namespace detail
+
+/// `single_pixel_visiblity` specialized on the radius and number of rays.
+/// Gives exactly the same counts as the generic kernel with
+/// `RayStencil(Radius, Angles)`.
+/// @tparam CheckBounds set to false only for observers inside of `interior_region`
+template<int Radius, int Angles, bool CheckBounds = true>
+[[nodiscard]]
+inline auto visibility(
+    const size_t x,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map) -> unsigned int
+{
+    return detail::static_pixel_visibility<Radius, Angles, CheckBounds>(
+        x, y, width, height, height_map, std::make_index_sequence<static_cast<size_t>(Angles)>{});
+}
+
+/// `row_visibility` specialized on the radius and number of rays
+template<int Radius, int Angles>
+auto visibility_row(
+    const size_t y,
+    const size_t x_begin,
+    const size_t x_end,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    unsigned int* output) -> void
+{
+    const auto interior = interior_region(static_stencil<Radius, Angles>, width, height);
+
+    // Rows near the top and bottom are border pixels all the way through
+    const size_t inner_begin = interior.contains_row(y) ? std::clamp(interior.x_begin, x_begin, x_end) : x_end;
+    const size_t inner_end = interior.contains_row(y) ? std::clamp(interior.x_end, inner_begin, x_end) : x_end;
+
+    size_t x = x_begin;
+    for (; x < inner_begin; ++x) {
+        output[x - x_begin] = visibility<Radius, Angles, true>(x, y, width, height, height_map);
+    }
+    for (; x < inner_end; ++x) {
+        output[x - x_begin] = visibility<Radius, Angles, false>(x, y, width, height, height_map);
+    }
+    for (; x < x_end; ++x) {
+        output[x - x_begin] = visibility<Radius, Angles, true>(x, y, width, height, height_map);
+    }
+}
+
+/// A row kernel with the signature of `visibility_row`
+using VisibilityRowKernel = void (*)(
+    size_t y, size_t x_begin, size_t x_end, size_t width, size_t height,
+    tcb::span<const int16_t> height_map, unsigned int* output);
+
+/// Looks up the specialized kernel for `(radius, num_angles)`. The kernels
+/// are instantiated where this is called, so that they are compiled with the
+/// optimizations of the solver rather than those of the library.
+/// @returns the kernel, or nullptr if that configuration isn't compiled in
+///          (use the generic `row_visibility` instead)
+[[nodiscard]]
+inline auto find_visibility_kernel(const int radius, const int num_angles) -> VisibilityRowKernel
+{
+    struct Entry {
+        int radius;
+        int num_angles;
+        VisibilityRowKernel kernel;
+    };
+
+    // The configurations used in production
+    constexpr Entry kernels[] = {
+        {100, 36, &visibility_row<100, 36>},
+        {100, 72, &visibility_row<100, 72>},
+    };
+
+    for (const auto& entry : kernels) {
+        if (entry.radius == radius && entry.num_angles == num_angles) { return entry.kernel; }
+    }
+
+    return nullptr;
+}
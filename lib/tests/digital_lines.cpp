@@ -0,0 +1,74 @@
+#include "digital_lines.hpp"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+TEST(DigitalLinesTest, EveryCellIsOnExactlyOneLine) {
+    const size_t width = 37;
+    const size_t height = 23;
+
+    for (int sector = 0; sector < 36; ++sector) {
+        const double angle = sector * 2 * 3.14159265358979323846 / 36;
+        const DigitalLines lines(width, height, angle);
+
+        std::vector<int> visits(width * height, 0);
+        for (size_t line = 0; line < lines.num_lines(); ++line) {
+            EXPECT_GT(lines.line_length(line), 0) << sector;
+            EXPECT_LE(lines.line_length(line), lines.max_line_length());
+            for (size_t i = 0; i < lines.line_length(line); ++i) {
+                ++visits[lines.cell(line, i)];
+            }
+        }
+
+        for (const int count : visits) {
+            EXPECT_EQ(count, 1) << sector;
+        }
+    }
+}
+
+TEST(DigitalLinesTest, LinesFollowTheDirection) {
+    const size_t width = 40;
+    const size_t height = 31;
+
+    for (const double angle : {0.0, 0.3, 1.2, 1.5707963267948966, 2.5, 3.141592653589793, 4.0, 5.9}) {
+        const DigitalLines lines(width, height, angle);
+
+        for (size_t line = 0; line < lines.num_lines(); ++line) {
+            for (size_t i = 1; i < lines.line_length(line); ++i) {
+                const auto previous = lines.cell(line, i - 1);
+                const auto current = lines.cell(line, i);
+                const auto dx = static_cast<int64_t>(current % width) - static_cast<int64_t>(previous % width);
+                const auto dy = static_cast<int64_t>(current / width) - static_cast<int64_t>(previous / width);
+
+                // One cell along the major axis, at most one along the other,
+                // and always forwards
+                EXPECT_EQ(std::max(std::abs(dx), std::abs(dy)), 1) << angle;
+                EXPECT_GT(static_cast<double>(dx) * std::cos(angle) + static_cast<double>(dy) * std::sin(angle), 0.0) << angle;
+            }
+        }
+
+        EXPECT_GE(lines.step(), 1.0);
+        EXPECT_LE(lines.step(), std::sqrt(2.0) + 1e-9);
+    }
+}
+
+TEST(DigitalLinesTest, CellsKnowTheirLineAndPosition) {
+    const size_t width = 29;
+    const size_t height = 34;
+
+    for (int sector = 0; sector < 24; ++sector) {
+        const double angle = sector * 2 * 3.14159265358979323846 / 24;
+        const DigitalLines lines(width, height, angle);
+
+        for (size_t line = 0; line < lines.num_lines(); ++line) {
+            EXPECT_LE(lines.first_position(line) + lines.line_length(line), lines.max_line_length());
+            for (size_t i = 0; i < lines.line_length(line); ++i) {
+                const auto cell = lines.cell(line, i);
+                EXPECT_EQ(lines.line_of(cell % width, cell / width), line) << sector;
+                EXPECT_EQ(lines.position_of(cell % width, cell / width), lines.first_position(line) + i) << sector;
+            }
+        }
+    }
+}
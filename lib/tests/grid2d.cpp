@@ -0,0 +1,52 @@
+#include "core.hpp"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <vector>
+
+TEST(Grid2dTest, RowsAreContiguous) {
+    std::vector<int16_t> data(3 * 5);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<int16_t>(i);
+    }
+
+    const auto grid = to_grid(tcb::span(data.data(), data.size()), 5, 3);
+    ASSERT_EQ(grid.rows(), 3);
+    ASSERT_EQ(grid.cols(), 5);
+    ASSERT_EQ(grid.size(), data.size());
+
+    for (size_t row = 0; row < grid.rows(); ++row) {
+        for (size_t col = 0; col < grid.cols(); ++col) {
+            EXPECT_EQ(&grid(row, col), &data[row * 5 + col]);
+        }
+        EXPECT_EQ(grid.row(row).data(), &data[row * 5]);
+        EXPECT_EQ(grid.row(row).size(), 5);
+    }
+}
+
+TEST(Grid2dTest, WritesGoThroughToTheData) {
+    std::vector<uint8_t> data(4 * 4, 0);
+    auto grid = grid_u8(data.data(), 4, 4);
+
+    grid(2, 1) = 7;
+    EXPECT_EQ(data[2 * 4 + 1], 7);
+}
+
+TEST(Grid2dTest, ContainsChecksBothBounds) {
+    std::vector<int16_t> data(2 * 3);
+    const auto grid = grid_i16(data.data(), 2, 3);
+
+    EXPECT_TRUE(grid.contains(0, 0));
+    EXPECT_TRUE(grid.contains(1, 2));
+    EXPECT_FALSE(grid.contains(2, 0));
+    EXPECT_FALSE(grid.contains(0, 3));
+    EXPECT_FALSE(grid.contains(int64_t{-1}, int64_t{0}));
+    EXPECT_FALSE(grid.contains(int64_t{0}, int64_t{-1}));
+}
+
+TEST(Grid2dTest, MismatchedSizeGivesAnEmptyGrid) {
+    std::vector<int16_t> data(10);
+    const auto grid = to_grid(tcb::span(data.data(), data.size()), 4, 3);
+
+    EXPECT_EQ(grid.size(), 0);
+    EXPECT_EQ(grid.data(), nullptr);
+}
@@ -0,0 +1,101 @@
+#include "core.hpp"
+#include "height_pyramid.hpp"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace {
+    /// Smooth hills with some noise, plus negative values that read as large heights
+    auto make_map(const size_t width, const size_t height) -> std::vector<int16_t>
+    {
+        std::vector<int16_t> height_map(width * height);
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                const double hills = 400.0 * std::sin(static_cast<double>(x) / 9.0) * std::cos(static_cast<double>(y) / 13.0);
+                height_map[y * width + x] = static_cast<int16_t>(500.0 + hills + static_cast<double>((x * 31 + y * 17) % 23));
+            }
+        }
+        height_map[7 * width + 11] = -3;
+        return height_map;
+    }
+}
+
+TEST(HeightPyramidTest, MaxInMatchesBruteForce) {
+    const size_t width = 37;
+    const size_t height = 29;
+    const auto height_map = make_map(width, height);
+    const HeightPyramid pyramid(height_map, width, height);
+
+    // 37 wide halves down to 1 in 6 steps
+    EXPECT_EQ(pyramid.num_levels(), 7);
+
+    for (size_t y_begin = 0; y_begin < height; y_begin += 3) {
+        for (size_t x_begin = 0; x_begin < width; x_begin += 2) {
+            for (size_t y_end = y_begin; y_end < height; y_end += 5) {
+                for (size_t x_end = x_begin; x_end < width; x_end += 4) {
+                    uint16_t expected = 0;
+                    for (size_t y = y_begin; y <= y_end; ++y) {
+                        for (size_t x = x_begin; x <= x_end; ++x) {
+                            expected = std::max(expected, static_cast<uint16_t>(height_map[y * width + x]));
+                        }
+                    }
+
+                    // An upper bound, and exact for single cells
+                    const auto bound = pyramid.max_in(x_begin, y_begin, x_end, y_end);
+                    EXPECT_GE(bound, expected);
+                    if (x_begin == x_end && y_begin == y_end) { EXPECT_EQ(bound, expected); }
+                }
+            }
+        }
+    }
+
+    EXPECT_EQ(pyramid.max_in(0, 0, width - 1, height - 1), static_cast<uint16_t>(-3));
+}
+
+TEST(HeightPyramidTest, SegmentsCoverEveryRay) {
+    const RayStencil stencil(20, 12);
+    const RaySegments segments(stencil, 6);
+
+    for (size_t ray = 0; ray < stencil.num_rays(); ++ray) {
+        size_t next_step = stencil.ray_begin(ray);
+        for (size_t segment = segments.ray_begin(ray); segment < segments.ray_end(ray); ++segment) {
+            const auto& bound = segments.segments()[segment];
+            EXPECT_EQ(bound.begin, next_step);
+            EXPECT_LE(bound.end - bound.begin, 6);
+
+            for (size_t step = bound.begin; step < bound.end; ++step) {
+                EXPECT_LE(bound.min_dx, stencil.dx()[step]);
+                EXPECT_GE(bound.max_dx, stencil.dx()[step]);
+                EXPECT_LE(bound.min_dy, stencil.dy()[step]);
+                EXPECT_GE(bound.max_dy, stencil.dy()[step]);
+                EXPECT_LE(bound.min_inv_dist, stencil.inv_dist()[step]);
+                EXPECT_GE(bound.max_inv_dist, stencil.inv_dist()[step]);
+            }
+
+            const auto extent = std::max(bound.max_dx - bound.min_dx, bound.max_dy - bound.min_dy);
+            EXPECT_GT(size_t{1} << bound.level, static_cast<size_t>(extent));
+            next_step = bound.end;
+        }
+        EXPECT_EQ(next_step, stencil.ray_end(ray));
+    }
+}
+
+TEST(HeightPyramidTest, PrunedRowsMatchRowVisibility) {
+    const size_t width = 90;
+    const size_t height = 70;
+    const auto height_map = make_map(width, height);
+    const HeightPyramid pyramid(height_map, width, height);
+    const RayStencil stencil(25, 24);
+    const RaySegments segments(stencil, 5);
+    const auto interior = interior_region(stencil, width, height);
+
+    std::vector<unsigned int> expected(width);
+    std::vector<unsigned int> pruned(width);
+    for (size_t y = 0; y < height; ++y) {
+        row_visibility(y, 0, width, width, height, height_map, stencil, interior, expected.data());
+        pruned_row_visibility(y, 0, width, width, height, height_map, stencil, segments, pyramid, interior, pruned.data());
+        EXPECT_EQ(pruned, expected) << "row " << y;
+    }
+}
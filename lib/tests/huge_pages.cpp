@@ -0,0 +1,78 @@
+#include "huge_pages.hpp"
+#include "core.hpp"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <vector>
+
+TEST(HugePagesTest, LargeAllocationsAreAlignedAndZeroed) {
+    const size_t bytes = 3 * HugePageSize + 123;
+    auto* data = static_cast<unsigned char*>(huge_page_allocate(bytes));
+    ASSERT_NE(data, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(data) % HugePageSize, 0);
+
+    for (size_t i = 0; i < bytes; ++i) {
+        ASSERT_EQ(data[i], 0) << i;
+    }
+    data[bytes - 1] = 1;
+
+    huge_page_free(data, bytes);
+}
+
+TEST(HugePagesTest, SmallAllocationsWork) {
+    for (const size_t bytes : {size_t{1}, size_t{4096}, HugePageSize / 2 - 1}) {
+        auto* data = static_cast<unsigned char*>(huge_page_allocate(bytes));
+        ASSERT_NE(data, nullptr);
+        data[0] = 1;
+        data[bytes - 1] = 2;
+        huge_page_free(data, bytes);
+    }
+}
+
+TEST(HugePagesTest, VectorsKeepTheirContents) {
+    huge_vector<uint32_t> values(HugePageSize / sizeof(uint32_t) * 2 + 17, 0);
+    std::iota(values.begin(), values.end(), 0u);
+
+    // Growing moves everything into a new mapping
+    values.resize(values.size() * 3);
+    for (size_t i = 0; i < values.size() / 3; ++i) {
+        ASSERT_EQ(values[i], i);
+    }
+    for (size_t i = values.size() / 3; i < values.size(); ++i) {
+        ASSERT_EQ(values[i], 0u);
+    }
+
+    huge_vector<uint32_t> copy = values;
+    EXPECT_EQ(copy, values);
+}
+
+TEST(HugePagesTest, UsageNeverExceedsTheRange) {
+    huge_vector<int16_t> values(HugePageSize * 2, 1);
+
+    const auto usage = huge_page_usage(values.data(), values.size() * sizeof(int16_t));
+    EXPECT_EQ(usage.bytes, values.size() * sizeof(int16_t));
+    EXPECT_LE(usage.huge_bytes, usage.bytes);
+    EXPECT_FALSE(describe_huge_pages(usage).empty());
+
+    EXPECT_EQ(describe_huge_pages(HugePageUsage{size_t{1} << 20, 0, false}), "none of 1.0 MiB on huge pages");
+    EXPECT_EQ(describe_huge_pages(HugePageUsage{size_t{4} << 20, size_t{2} << 20, false}), "2.0 of 4.0 MiB on transparent huge pages");
+}
+
+TEST(HugePagesTest, ReadsInputOntoHugePages) {
+    const std::filesystem::path file = "__huge_pages_test__.raw";
+    std::vector<int16_t> expected(HugePageSize, 0);
+    std::iota(expected.begin(), expected.end(), int16_t{0});
+    {
+        std::ofstream output(file, std::ios::binary);
+        output.write(reinterpret_cast<const char*>(expected.data()), static_cast<std::streamsize>(expected.size() * sizeof(int16_t)));
+    }
+
+    const auto actual = read_input<huge_page_allocator<int16_t>>(file);
+    std::filesystem::remove(file);
+
+    ASSERT_EQ(actual.size(), expected.size());
+    EXPECT_TRUE(std::equal(actual.begin(), actual.end(), expected.begin()));
+}
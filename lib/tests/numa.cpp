@@ -0,0 +1,88 @@
+#include "numa.hpp"
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+TEST(NumaTest, ParsesCpuLists) {
+    EXPECT_EQ(parse_cpu_list("0"), (std::vector<size_t>{0}));
+    EXPECT_EQ(parse_cpu_list("0-3"), (std::vector<size_t>{0, 1, 2, 3}));
+    EXPECT_EQ(parse_cpu_list("8,0-1,10-11"), (std::vector<size_t>{0, 1, 8, 10, 11}));
+
+    EXPECT_TRUE(parse_cpu_list("").empty());
+    EXPECT_TRUE(parse_cpu_list("3-1").empty());
+    EXPECT_TRUE(parse_cpu_list("0,x").empty());
+}
+
+TEST(NumaTest, FormatsCpuLists) {
+    EXPECT_EQ(format_cpu_list({}), "");
+    EXPECT_EQ(format_cpu_list({4}), "4");
+    EXPECT_EQ(format_cpu_list({11, 0, 1, 8, 10, 1}), "0-1,8,10-11");
+
+    for (const auto* list : {"0-3", "0,2,4", "0-1,8,10-11"}) {
+        EXPECT_EQ(format_cpu_list(parse_cpu_list(list)), list);
+    }
+}
+
+TEST(NumaTest, PlacesThreadsInBlocksPerNode) {
+    const NumaTopology topology{{{0, 1, 2, 3}, {4, 5, 6, 7}}};
+
+    const auto placement = place_threads(topology, 6);
+    EXPECT_EQ(placement.num_nodes, 2);
+    EXPECT_EQ(placement.thread_node, (std::vector<size_t>{0, 0, 0, 1, 1, 1}));
+    EXPECT_EQ(placement.thread_cpu, (std::vector<size_t>{0, 1, 2, 4, 5, 6}));
+
+    // More threads than CPUs start over on the CPUs of their node
+    const auto crowded = place_threads(topology, 12);
+    EXPECT_EQ(crowded.thread_node, (std::vector<size_t>{0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1}));
+    EXPECT_EQ(crowded.thread_cpu, (std::vector<size_t>{0, 1, 2, 3, 0, 1, 4, 5, 6, 7, 4, 5}));
+
+    // Fewer threads than nodes leave the last nodes empty
+    const auto single = place_threads(topology, 1);
+    EXPECT_EQ(single.num_nodes, 1);
+    EXPECT_EQ(single.thread_cpu, (std::vector<size_t>{0}));
+
+    EXPECT_TRUE(place_threads(topology, 0).thread_cpu.empty());
+}
+
+TEST(NumaTest, TopologyHasEveryThreadSomewhere) {
+    const auto topology = read_numa_topology();
+    ASSERT_FALSE(topology.node_cpus.empty());
+    for (const auto& cpus : topology.node_cpus) {
+        EXPECT_FALSE(cpus.empty());
+    }
+
+    const auto placement = place_threads(topology, 3);
+    EXPECT_EQ(placement.thread_cpu.size(), 3);
+    EXPECT_EQ(placement.thread_node.size(), 3);
+}
+
+TEST(NumaTest, UnpinningGivesTheCpusBack) {
+    const auto cpus = thread_cpus();
+    if (cpus.empty()) { GTEST_SKIP() << "Thread affinity isn't supported"; }
+
+    ASSERT_TRUE(pin_thread(cpus.back(), 1));
+    EXPECT_EQ(thread_cpus(), (std::vector<size_t>{cpus.back()}));
+    EXPECT_EQ(current_numa_node(), 1);
+
+    EXPECT_TRUE(unpin_thread(cpus));
+    EXPECT_EQ(thread_cpus(), cpus);
+    EXPECT_EQ(current_numa_node(), 0);
+}
+
+TEST(NumaTest, ReleasedPagesComeBackZeroed) {
+    // Large enough to hold a few whole pages wherever it starts
+    constexpr size_t Size = size_t{1} << 20;
+    std::vector<unsigned int> data(Size, 7u);
+
+    const size_t released = release_pages(data.data(), data.size() * sizeof(unsigned int));
+    EXPECT_LE(released, data.size() * sizeof(unsigned int));
+
+    // Whatever was given back reads as zeros, the rest is untouched
+    size_t zeros = 0;
+    for (const auto value : data) {
+        EXPECT_TRUE(value == 0u || value == 7u);
+        zeros += value == 0u ? 1 : 0;
+    }
+    EXPECT_EQ(zeros * sizeof(unsigned int), released);
+}
@@ -0,0 +1,149 @@
+#include "core.hpp"
+#include "radial_sweep.hpp"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace {
+    auto make_map(const size_t width, const size_t height) -> std::vector<int16_t>
+    {
+        std::vector<int16_t> height_map(width * height);
+        for (size_t i = 0; i < height_map.size(); ++i) {
+            height_map[i] = static_cast<int16_t>((i * 7919) % 50);
+        }
+        return height_map;
+    }
+
+    /// Checks every closer cell on the map whose square touches the line of
+    /// sight, straight from the definition
+    auto brute_force_visible(const size_t x, const size_t y, const mat_2d_i16 heights, const SweepStencil& stencil) -> unsigned int
+    {
+        const auto on_map = [&](const SweepStencil::Cell& cell) {
+            const int64_t cell_x = static_cast<int64_t>(x) + cell.dx;
+            const int64_t cell_y = static_cast<int64_t>(y) + cell.dy;
+            return cell_x >= 0 && cell_x < static_cast<int64_t>(heights.extent(1)) &&
+                   cell_y >= 0 && cell_y < static_cast<int64_t>(heights.extent(0));
+        };
+        const auto slope = [&](const SweepStencil::Cell& cell) {
+            const auto point = static_cast<uint16_t>(heights(static_cast<size_t>(static_cast<int64_t>(y) + cell.dy),
+                                                             static_cast<size_t>(static_cast<int64_t>(x) + cell.dx)));
+            return (static_cast<float>(point) - static_cast<float>(static_cast<uint16_t>(heights(y, x)))) * cell.inv_dist;
+        };
+        const auto dist_squared = [](const SweepStencil::Cell& cell) { return cell.dx * cell.dx + cell.dy * cell.dy; };
+
+        unsigned int visible_count = 1;
+        for (const auto& target : stencil.cells()) {
+            if (!on_map(target)) { continue; }
+
+            // In half cells, so corners are integers
+            const int64_t dir_x = 2 * target.dx;
+            const int64_t dir_y = 2 * target.dy;
+
+            float max_slope = -std::numeric_limits<float>::infinity();
+            for (const auto& cell : stencil.cells()) {
+                if (!on_map(cell) || dist_squared(cell) >= dist_squared(target)) { continue; }
+                if (dir_x * 2 * cell.dx + dir_y * 2 * cell.dy <= 0) { continue; }
+
+                int64_t min_cross = std::numeric_limits<int64_t>::max();
+                int64_t max_cross = std::numeric_limits<int64_t>::min();
+                for (const int corner_x : {-1, 1}) {
+                    for (const int corner_y : {-1, 1}) {
+                        const int64_t cross = dir_x * (2 * cell.dy + corner_y) - dir_y * (2 * cell.dx + corner_x);
+                        min_cross = std::min(min_cross, cross);
+                        max_cross = std::max(max_cross, cross);
+                    }
+                }
+                if (min_cross <= 0 && max_cross >= 0) { max_slope = std::max(max_slope, slope(cell)); }
+            }
+
+            visible_count += slope(target) > max_slope ? 1u : 0u;
+        }
+        return visible_count;
+    }
+}
+
+TEST(RadialSweepTest, CellsAreSortedByDistance) {
+    const SweepStencil stencil(10);
+    const auto& cells = stencil.cells();
+    const auto dist_squared = [](const SweepStencil::Cell& cell) { return cell.dx * cell.dx + cell.dy * cell.dy; };
+
+    for (size_t i = 0; i < cells.size(); ++i) {
+        EXPECT_GT(dist_squared(cells[i]), 0);
+        EXPECT_LE(dist_squared(cells[i]), 100);
+        EXPECT_LE(cells[i].closer, i);
+        if (cells[i].closer > 0) { EXPECT_LT(dist_squared(cells[cells[i].closer - 1]), dist_squared(cells[i])); }
+        EXPECT_EQ(dist_squared(cells[cells[i].closer]), dist_squared(cells[i]));
+    }
+}
+
+TEST(RadialSweepTest, EveryCellEntersAndExitsOnce) {
+    const SweepStencil stencil(10);
+    std::vector<int> entered(stencil.cells().size(), 0);
+    std::vector<int> centers(stencil.cells().size(), 0);
+
+    for (const auto index : stencil.initially_active()) { ++entered[index]; }
+    for (const auto& event : stencil.events()) {
+        switch (event.kind) {
+            case SweepStencil::EventKind::enter:
+                ++entered[event.cell];
+                break;
+            case SweepStencil::EventKind::center:
+                EXPECT_EQ(entered[event.cell], 1);
+                ++centers[event.cell];
+                break;
+            case SweepStencil::EventKind::exit:
+                EXPECT_EQ(centers[event.cell], 1);
+                --entered[event.cell];
+                break;
+        }
+    }
+
+    // The sweep ends inside of the cells it started in
+    for (const auto index : stencil.initially_active()) { EXPECT_EQ(entered[index], 1); --entered[index]; }
+    for (size_t i = 0; i < entered.size(); ++i) {
+        EXPECT_EQ(entered[i], 0);
+        EXPECT_EQ(centers[i], 1);
+    }
+}
+
+TEST(RadialSweepTest, MatchesBruteForce) {
+    const size_t width = 23;
+    const size_t height = 19;
+    auto height_map = make_map(width, height);
+    const auto heights = to_span(tcb::span(height_map.data(), height_map.size()), height, width);
+    const SweepStencil stencil(7);
+    RadialSweep sweep(stencil);
+
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            EXPECT_EQ(sweep.count_visible(x, y, heights), brute_force_visible(x, y, heights, stencil)) << x << ", " << y;
+        }
+    }
+}
+
+TEST(RadialSweepTest, WallHidesTheCellsBehindIt) {
+    const size_t width = 21;
+    const size_t height = 21;
+    std::vector<int16_t> height_map(width * height, 0);
+    for (size_t y = 0; y < height; ++y) { height_map[y * width + 12] = 1000; }
+    const auto heights = to_span(tcb::span(height_map.data(), height_map.size()), height, width);
+
+    const SweepStencil stencil(8);
+    RadialSweep sweep(stencil);
+
+    std::vector<std::pair<size_t, size_t>> visible;
+    sweep.visible_cells(10, 10, heights, [&](const size_t x, const size_t y) { visible.emplace_back(x, y); });
+
+    // The flat ground beyond the first ring is hidden by the ring itself, and
+    // nothing behind the wall shows
+    for (const auto& [x, y] : visible) {
+        EXPECT_LE(x, 12);
+        EXPECT_TRUE(x == 12 || (std::max(x, size_t{10}) - std::min(x, size_t{10}) <= 1 &&
+                                std::max(y, size_t{10}) - std::min(y, size_t{10}) <= 1));
+    }
+    for (const size_t y : {size_t{9}, size_t{10}, size_t{11}}) {
+        EXPECT_NE(std::find(visible.begin(), visible.end(), std::pair<size_t, size_t>{12, y}), visible.end()) << y;
+    }
+}
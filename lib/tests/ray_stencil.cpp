@@ -0,0 +1,179 @@
+#include "core.hpp"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+TEST(RayStencilTest, OneRayPerAngle) {
+    const RayStencil stencil(100, 36);
+
+    EXPECT_EQ(stencil.radius(), 100);
+    EXPECT_EQ(stencil.num_rays(), 36u);
+    EXPECT_EQ(stencil.ray_offsets().size(), 37u);
+    EXPECT_EQ(stencil.ray_begin(0), 0u);
+    EXPECT_EQ(stencil.ray_end(35), stencil.num_steps());
+}
+
+TEST(RayStencilTest, StepsStayInsideRadius) {
+    const RayStencil stencil(50, 72);
+
+    for (size_t ray = 0; ray < stencil.num_rays(); ++ray) {
+        // Every ray takes at least a few steps, but never more than the radius
+        EXPECT_GT(stencil.ray_end(ray) - stencil.ray_begin(ray), 30u);
+        EXPECT_LE(stencil.ray_end(ray) - stencil.ray_begin(ray), 50u);
+
+        for (size_t step = stencil.ray_begin(ray); step < stencil.ray_end(ray); ++step) {
+            const auto dx = stencil.dx()[step];
+            const auto dy = stencil.dy()[step];
+            EXPECT_LE(dx * dx + dy * dy, 50 * 50);
+        }
+    }
+}
+
+TEST(RayStencilTest, InverseDistanceMatchesOffsets) {
+    const RayStencil stencil(100, 36);
+
+    for (size_t step = 0; step < stencil.num_steps(); ++step) {
+        const auto dx = stencil.dx()[step];
+        const auto dy = stencil.dy()[step];
+        const auto dist = std::sqrt(static_cast<float>(dx * dx + dy * dy));
+        EXPECT_FLOAT_EQ(stencil.inv_dist()[step], 1.0f / dist);
+    }
+}
+
+TEST(RayStencilTest, NoRepeatedCells) {
+    const RayStencil stencil(100, 72);
+
+    for (size_t ray = 0; ray < stencil.num_rays(); ++ray) {
+        int32_t last_x = 0;
+        int32_t last_y = 0;
+        for (size_t step = stencil.ray_begin(ray); step < stencil.ray_end(ray); ++step) {
+            const auto dx = stencil.dx()[step];
+            const auto dy = stencil.dy()[step];
+            EXPECT_FALSE(dx == last_x && dy == last_y);
+            last_x = dx;
+            last_y = dy;
+        }
+    }
+}
+
+TEST(RayStencilTest, FlatMapSeesFirstStepOfEveryRay) {
+    const size_t width = 64;
+    const size_t height = 48;
+    const std::vector<int16_t> height_map(width * height, 10);
+    const RayStencil stencil(10, 36);
+
+    // On a flat map only the first cell of every ray is visible (every other
+    // cell has the same angle of zero)
+    EXPECT_EQ(single_pixel_visiblity(32, 24, width, height, height_map, stencil), 37u);
+
+    // Rays that leave the map right away don't see anything
+    EXPECT_LT(single_pixel_visiblity(0, 0, width, height, height_map, stencil), 37u);
+}
+
+TEST(RayStencilTest, PeakHidesCellsBehindIt) {
+    const size_t width = 64;
+    const size_t height = 64;
+    const RayStencil stencil(20, 4);
+    std::vector<int16_t> height_map(width * height, 0);
+
+    // An increasing slope is entirely visible
+    for (size_t x = 0; x < width; ++x) {
+        height_map[32 * width + x] = static_cast<int16_t>(x * x);
+        height_map[33 * width + x] = static_cast<int16_t>(x * x);
+    }
+    const auto slope_count = single_pixel_visiblity(32, 32, width, height, height_map, stencil);
+
+    // A tall peak right next to the observer hides the slope behind it
+    height_map[32 * width + 34] = 10000;
+    height_map[33 * width + 34] = 10000;
+    const auto peak_count = single_pixel_visiblity(32, 32, width, height, height_map, stencil);
+
+    EXPECT_LT(peak_count, slope_count);
+}
+
+TEST(RayStencilTest, InteriorRegionKeepsRaysOnTheMap) {
+    const size_t width = 80;
+    const size_t height = 60;
+    const RayStencil stencil(20, 36);
+    const auto interior = interior_region(stencil, width, height);
+
+    EXPECT_EQ(interior.x_begin, static_cast<size_t>(-stencil.min_dx()));
+    EXPECT_EQ(interior.x_end, width - static_cast<size_t>(stencil.max_dx()));
+    EXPECT_EQ(interior.y_begin, static_cast<size_t>(-stencil.min_dy()));
+    EXPECT_EQ(interior.y_end, height - static_cast<size_t>(stencil.max_dy()));
+
+    // The corners of the interior can still reach the edges of the map
+    for (const auto& [x, y] : {std::pair{interior.x_begin, interior.y_begin},
+                              std::pair{interior.x_end - 1, interior.y_end - 1}}) {
+        for (size_t step = 0; step < stencil.num_steps(); ++step) {
+            const auto curr_x = static_cast<int>(x) + stencil.dx()[step];
+            const auto curr_y = static_cast<int>(y) + stencil.dy()[step];
+            EXPECT_TRUE(curr_x >= 0 && curr_x < static_cast<int>(width));
+            EXPECT_TRUE(curr_y >= 0 && curr_y < static_cast<int>(height));
+        }
+    }
+
+    // A map smaller than the stencil has no interior at all
+    const auto none = interior_region(stencil, 10, 10);
+    EXPECT_FALSE(none.contains(5, 5));
+}
+
+TEST(RayStencilTest, RowVisibilityMatchesCheckedKernel) {
+    const size_t width = 70;
+    const size_t height = 50;
+    const RayStencil stencil(15, 24);
+    const auto interior = interior_region(stencil, width, height);
+
+    std::vector<int16_t> height_map(width * height);
+    for (size_t i = 0; i < height_map.size(); ++i) {
+        height_map[i] = static_cast<int16_t>((i * 7919) % 1000);
+    }
+
+    std::vector<unsigned int> row(width);
+    for (size_t y = 0; y < height; ++y) {
+        row_visibility(y, 0, width, width, height, height_map, stencil, interior, row.data());
+        for (size_t x = 0; x < width; ++x) {
+            EXPECT_EQ(row[x], single_pixel_visiblity(x, y, width, height, height_map, stencil));
+        }
+    }
+}
+
+TEST(RayStencilTest, FixedSlopeRoundsLikeFloat) {
+    const RayStencil stencil(100, 36);
+
+    // Every slope scale is the float inverse distance, scaled by the same power of two
+    const double scale = static_cast<double>(stencil.slope_scale()[0]) / static_cast<double>(stencil.inv_dist()[0]);
+
+    for (size_t step = 0; step < stencil.num_steps(); step += 7) {
+        for (int64_t height_diff = -65535; height_diff <= 65535; height_diff += 257) {
+            const float slope = static_cast<float>(height_diff) * stencil.inv_dist()[step];
+            const int64_t exact = height_diff * stencil.slope_scale()[step];
+
+            // Rounding the exact product gives the float product
+            EXPECT_EQ(static_cast<double>(detail::round_slope(exact)), static_cast<double>(slope) * scale);
+        }
+    }
+}
+
+TEST(RayStencilTest, FixedSlopeModeMatchesFloatingPoint) {
+    const size_t width = 90;
+    const size_t height = 70;
+    const RayStencil stencil(25, 36);
+    const auto interior = interior_region(stencil, width, height);
+
+    // Lots of repeated heights, so lots of exact ties between slopes
+    std::vector<int16_t> height_map(width * height);
+    for (size_t i = 0; i < height_map.size(); ++i) {
+        height_map[i] = static_cast<int16_t>(((i * 7919) % 13) * 100);
+    }
+
+    std::vector<unsigned int> floating(width);
+    std::vector<unsigned int> fixed(width);
+    for (size_t y = 0; y < height; ++y) {
+        row_visibility(y, 0, width, width, height, height_map, stencil, interior, floating.data(), SlopeMode::floating);
+        row_visibility(y, 0, width, width, height, height_map, stencil, interior, fixed.data(), SlopeMode::fixed);
+        EXPECT_EQ(fixed, floating);
+    }
+}
@@ -0,0 +1,74 @@
+#include "core.hpp"
+#include "static_visibility.hpp"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <vector>
+
+namespace {
+    auto make_map(const size_t width, const size_t height) -> std::vector<int16_t>
+    {
+        std::vector<int16_t> height_map(width * height);
+        for (size_t i = 0; i < height_map.size(); ++i) {
+            height_map[i] = static_cast<int16_t>((i * 7919) % 1000);
+        }
+        return height_map;
+    }
+}
+
+TEST(StaticVisibilityTest, TablesMatchRayStencil) {
+    constexpr auto& tables = static_stencil<30, 20>;
+    const RayStencil stencil(30, 20);
+
+    for (size_t ray = 0; ray <= stencil.num_rays(); ++ray) {
+        EXPECT_EQ(tables.ray_offsets[ray], stencil.ray_offsets()[ray]);
+    }
+    for (size_t step = 0; step < stencil.num_steps(); ++step) {
+        EXPECT_EQ(tables.dx[step], stencil.dx()[step]);
+        EXPECT_EQ(tables.dy[step], stencil.dy()[step]);
+        EXPECT_EQ(tables.inv_dist[step], stencil.inv_dist()[step]);
+    }
+
+    EXPECT_EQ(tables.min_dx(), stencil.min_dx());
+    EXPECT_EQ(tables.max_dy(), stencil.max_dy());
+}
+
+TEST(StaticVisibilityTest, MatchesGenericKernel) {
+    const size_t width = 60;
+    const size_t height = 45;
+    const auto height_map = make_map(width, height);
+    const RayStencil stencil(12, 16);
+
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            EXPECT_EQ((visibility<12, 16>(x, y, width, height, height_map)),
+                      single_pixel_visiblity(x, y, width, height, height_map, stencil));
+        }
+    }
+}
+
+TEST(StaticVisibilityTest, FindsOnlyCompiledConfigurations) {
+    EXPECT_NE(find_visibility_kernel(100, 36), nullptr);
+    EXPECT_NE(find_visibility_kernel(100, 72), nullptr);
+    EXPECT_EQ(find_visibility_kernel(100, 37), nullptr);
+    EXPECT_EQ(find_visibility_kernel(50, 36), nullptr);
+}
+
+TEST(StaticVisibilityTest, CompiledKernelMatchesRowVisibility) {
+    const size_t width = 260;
+    const size_t height = 230;
+    const auto height_map = make_map(width, height);
+    const RayStencil stencil(100, 36);
+    const auto interior = interior_region(stencil, width, height);
+    const auto kernel = find_visibility_kernel(100, 36);
+    ASSERT_NE(kernel, nullptr);
+
+    std::vector<unsigned int> expected(width);
+    std::vector<unsigned int> actual(width);
+
+    // A few border rows and a few interior rows
+    for (const size_t y : {size_t{0}, size_t{57}, size_t{115}, size_t{229}}) {
+        row_visibility(y, 0, width, width, height, height_map, stencil, interior, expected.data());
+        kernel(y, 0, width, width, height, height_map, actual.data());
+        EXPECT_EQ(actual, expected);
+    }
+}
@@ -0,0 +1,65 @@
+#include "thread_pool.hpp"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+TEST(ThreadPoolTest, EveryTaskRunsOnce) {
+    WorkStealingPool pool(4);
+    ASSERT_EQ(pool.num_workers(), 4);
+
+    for (const size_t num_tasks : {size_t{0}, size_t{1}, size_t{3}, size_t{1000}}) {
+        std::vector<std::atomic<int>> runs(num_tasks);
+        pool.run(num_tasks, [&](const size_t task) { runs[task].fetch_add(1); });
+
+        for (const auto& count : runs) {
+            EXPECT_EQ(count.load(), 1) << num_tasks;
+        }
+
+        size_t tasks = 0;
+        for (const auto& stats : pool.stats()) {
+            tasks += stats.tasks;
+            EXPECT_LE(stats.stolen, stats.tasks);
+        }
+        EXPECT_EQ(tasks, num_tasks);
+    }
+}
+
+TEST(ThreadPoolTest, IdleWorkersStealTheTail) {
+    WorkStealingPool pool(2);
+
+    // All the slow tasks are in the first worker's block, so the second one
+    // runs out of its own work first and has to take some of them
+    pool.run(20, [](const size_t task) {
+        if (task < 10) { std::this_thread::sleep_for(std::chrono::milliseconds(5)); }
+    });
+
+    const auto& stats = pool.stats();
+    ASSERT_EQ(stats.size(), 2);
+    EXPECT_EQ(stats[0].stolen, 0);
+    EXPECT_GT(stats[1].stolen, 0);
+    EXPECT_EQ(stats[0].tasks + stats[1].tasks, 20);
+}
+
+TEST(ThreadPoolTest, BusyAndIdleAddUpToTheRun) {
+    WorkStealingPool pool(3);
+
+    const auto begin = std::chrono::steady_clock::now();
+    pool.run(6, [](const size_t) { std::this_thread::sleep_for(std::chrono::milliseconds(2)); });
+    const auto elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+
+    for (const auto& stats : pool.stats()) {
+        EXPECT_GT(stats.busy_ns, 0);
+        EXPECT_LE(stats.busy_ns + stats.idle_ns, elapsed);
+    }
+}
+
+TEST(ThreadPoolTest, PoolCanBeReused) {
+    WorkStealingPool pool(2);
+
+    std::atomic<size_t> sum{0};
+    for (int round = 0; round < 50; ++round) {
+        pool.run(10, [&](const size_t task) { sum.fetch_add(task); });
+    }
+    EXPECT_EQ(sum.load(), 50 * 45);
+}
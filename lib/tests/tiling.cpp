@@ -0,0 +1,142 @@
+#include "tiling.hpp"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+TEST(TilingTest, TilesCoverEveryObserverOnce) {
+    const size_t width = 53;
+    const size_t height = 37;
+
+    for (const size_t tile_size : {size_t{1}, size_t{8}, size_t{16}, size_t{53}, size_t{100}}) {
+        std::vector<int> visits(width * height, 0);
+        for (const auto& tile : morton_tiles(width, height, tile_size)) {
+            EXPECT_LT(tile.x_begin, tile.x_end);
+            EXPECT_LT(tile.y_begin, tile.y_end);
+            EXPECT_LE(tile.x_end - tile.x_begin, tile_size);
+            EXPECT_LE(tile.y_end - tile.y_begin, tile_size);
+
+            for (size_t y = tile.y_begin; y < tile.y_end; ++y) {
+                for (size_t x = tile.x_begin; x < tile.x_end; ++x) {
+                    ++visits[y * width + x];
+                }
+            }
+        }
+
+        for (const int count : visits) {
+            EXPECT_EQ(count, 1) << tile_size;
+        }
+    }
+}
+
+TEST(TilingTest, TilesAreInZOrder) {
+    const auto tiles = morton_tiles(40, 40, 10);
+    ASSERT_EQ(tiles.size(), 16);
+
+    // The four quadrants one after the other, each of them in Z order too
+    const std::vector<std::pair<size_t, size_t>> expected = {
+        {0, 0}, {10, 0}, {0, 10}, {10, 10},
+        {20, 0}, {30, 0}, {20, 10}, {30, 10},
+        {0, 20}, {10, 20}, {0, 30}, {10, 30},
+        {20, 20}, {30, 20}, {20, 30}, {30, 30},
+    };
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        EXPECT_EQ(tiles[i].x_begin, expected[i].first) << i;
+        EXPECT_EQ(tiles[i].y_begin, expected[i].second) << i;
+    }
+}
+
+TEST(TilingTest, MortonCodeInterleavesBits) {
+    EXPECT_EQ(morton_code(0, 0), 0);
+    EXPECT_EQ(morton_code(1, 0), 1);
+    EXPECT_EQ(morton_code(0, 1), 2);
+    EXPECT_EQ(morton_code(3, 3), 15);
+    EXPECT_EQ(morton_code(0xFFFFFFFFu, 0), 0x5555555555555555ull);
+}
+
+TEST(TilingTest, EmptyMapHasNoTiles) {
+    EXPECT_TRUE(morton_tiles(0, 10, 8).empty());
+    EXPECT_TRUE(morton_tiles(10, 10, 0).empty());
+}
+
+TEST(TilingTest, CacheTileHeightsFitTheCache) {
+    for (const int radius : {10, 50, 100}) {
+        for (const size_t cache : {size_t{256} << 10, size_t{1} << 20, size_t{2} << 20}) {
+            const size_t tile_size = cache_tile_size(radius, cache);
+            const size_t side = tile_size + 2 * static_cast<size_t>(radius);
+
+            EXPECT_EQ(tile_size % 8, 0);
+            EXPECT_GE(tile_size, 8);
+            if (tile_size > 8) {
+                EXPECT_LE(side * side * sizeof(int16_t), cache / 2) << radius << " " << cache;
+            }
+        }
+    }
+
+    // A tiny cache still gets the smallest tiles
+    EXPECT_EQ(cache_tile_size(100, 1024), 8);
+}
+
+TEST(TilingTest, FlatInteriorTileCostsEveryStep) {
+    const size_t width = 100;
+    const size_t height = 100;
+    const std::vector<int16_t> flat(width * height, 0);
+    const RayStencil stencil(10, 8);
+
+    // Only the first step of every ray rises above the horizon on a flat map
+    const Tile tile{40, 50, 40, 60};
+    const double per_observer = static_cast<double>(stencil.num_steps()) + NewHorizonCost * static_cast<double>(stencil.num_rays());
+    EXPECT_DOUBLE_EQ(estimate_tile_cost(tile, width, height, flat, stencil), per_observer * 10 * 20);
+}
+
+TEST(TilingTest, BorderTilesCostLess) {
+    const size_t width = 100;
+    const size_t height = 100;
+    const std::vector<int16_t> flat(width * height, 0);
+    const RayStencil stencil(20, 16);
+
+    const double corner = estimate_tile_cost(Tile{0, 10, 0, 10}, width, height, flat, stencil);
+    const double edge = estimate_tile_cost(Tile{40, 50, 0, 10}, width, height, flat, stencil);
+    const double interior = estimate_tile_cost(Tile{40, 50, 40, 50}, width, height, flat, stencil);
+    EXPECT_LT(corner, edge);
+    EXPECT_LT(edge, interior);
+}
+
+TEST(TilingTest, LptGivesTheLongestTilesToTheLeastLoaded) {
+    const auto assignment = lpt_assignment({5.0, 4.0, 3.0, 3.0, 3.0}, 2);
+    ASSERT_EQ(assignment.size(), 2);
+
+    // 5 -> 0, 4 -> 1, 3 -> 1 (7), 3 -> 0 (8), 3 -> 1 (10)
+    EXPECT_EQ(assignment[0], (std::vector<size_t>{0, 3}));
+    EXPECT_EQ(assignment[1], (std::vector<size_t>{1, 2, 4}));
+}
+
+TEST(TilingTest, LptAssignsEveryTileOnce) {
+    std::vector<double> costs;
+    for (size_t i = 0; i < 97; ++i) {
+        costs.push_back(static_cast<double>((i * 37) % 11 + 1));
+    }
+
+    const auto assignment = lpt_assignment(costs, 6);
+    ASSERT_EQ(assignment.size(), 6);
+
+    std::vector<int> seen(costs.size(), 0);
+    double lightest = 1e9;
+    double heaviest = 0.0;
+    for (const auto& tiles : assignment) {
+        EXPECT_TRUE(std::is_sorted(tiles.begin(), tiles.end()));
+        double load = 0.0;
+        for (const size_t tile : tiles) {
+            ++seen[tile];
+            load += costs[tile];
+        }
+        lightest = std::min(lightest, load);
+        heaviest = std::max(heaviest, load);
+    }
+    for (const int count : seen) {
+        EXPECT_EQ(count, 1);
+    }
+
+    // No worker is further behind than the most expensive tile
+    EXPECT_LE(heaviest - lightest, 11.0);
+}
@@ -0,0 +1,138 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+    using clock = std::chrono::steady_clock;
+
+    auto nanoseconds_since(const clock::time_point begin) -> uint64_t
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - begin).count());
+    }
+}
+
+WorkStealingPool::WorkStealingPool(const size_t num_workers, const std::function<void(size_t)>& on_start)
+{
+    const size_t count = num_workers != 0 ? num_workers : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    stats_.resize(count);
+    for (size_t worker = 0; worker < count; ++worker) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t worker = 0; worker < count; ++worker) {
+        workers_.emplace_back([this, worker, on_start] { work(worker, on_start); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        const std::lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    start_.notify_all();
+
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+auto WorkStealingPool::run(const size_t num_tasks, const std::function<void(size_t)>& task) -> void
+{
+    const size_t count = workers_.size();
+    std::fill(stats_.begin(), stats_.end(), WorkerStats{});
+    if (num_tasks == 0) { return; }
+
+    // Every worker starts with a contiguous block of the tasks
+    for (size_t worker = 0; worker < count; ++worker) {
+        const std::lock_guard lock(queues_[worker]->mutex);
+        auto& tasks = queues_[worker]->tasks;
+        tasks.clear();
+        for (size_t i = worker * num_tasks / count; i < (worker + 1) * num_tasks / count; ++i) {
+            tasks.push_back(i);
+        }
+    }
+
+    const auto begin = clock::now();
+    {
+        const std::lock_guard lock(mutex_);
+        task_ = &task;
+        running_ = count;
+        ++generation_;
+    }
+    start_.notify_all();
+
+    {
+        std::unique_lock lock(mutex_);
+        done_.wait(lock, [this] { return running_ == 0; });
+        task_ = nullptr;
+    }
+
+    // Whatever a worker didn't spend in its tasks it spent idle
+    const uint64_t elapsed = nanoseconds_since(begin);
+    for (auto& stats : stats_) {
+        stats.idle_ns = elapsed - std::min(elapsed, stats.busy_ns);
+    }
+}
+
+auto WorkStealingPool::work(const size_t worker, const std::function<void(size_t)> on_start) -> void
+{
+    if (on_start) { on_start(worker); }
+
+    uint64_t generation = 0;
+
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            start_.wait(lock, [&] { return stopping_ || generation_ != generation; });
+            if (stopping_) { return; }
+            generation = generation_;
+        }
+
+        // No task adds new ones, so once every queue is empty the run is over
+        // for this worker
+        auto& stats = stats_[worker];
+        size_t task = 0;
+        bool stolen = false;
+        while (take(worker, task) || (stolen = steal(worker, task))) {
+            const auto begin = clock::now();
+            (*task_)(task);
+            stats.busy_ns += nanoseconds_since(begin);
+            stats.tasks += 1;
+            stats.stolen += stolen ? 1 : 0;
+        }
+
+        {
+            const std::lock_guard lock(mutex_);
+            if (--running_ == 0) { done_.notify_one(); }
+        }
+    }
+}
+
+auto WorkStealingPool::take(const size_t worker, size_t& task) -> bool
+{
+    auto& queue = *queues_[worker];
+    const std::lock_guard lock(queue.mutex);
+    if (queue.tasks.empty()) { return false; }
+
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+}
+
+auto WorkStealingPool::steal(const size_t worker, size_t& task) -> bool
+{
+    // Look at the others in turn, starting with the next one, so that not
+    // every idle worker goes after the same victim
+    for (size_t offset = 1; offset < queues_.size(); ++offset) {
+        auto& queue = *queues_[(worker + offset) % queues_.size()];
+        const std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty()) { continue; }
+
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    return false;
+}
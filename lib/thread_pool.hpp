@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// How one worker of a `WorkStealingPool` spent the last `run`
+struct WorkerStats {
+    /// Time spent in tasks
+    uint64_t busy_ns = 0;
+    /// The rest of the run, looking for work or waiting for the others
+    uint64_t idle_ns = 0;
+    /// The number of tasks the worker ran
+    size_t tasks = 0;
+    /// How many of those it took from another worker
+    size_t stolen = 0;
+};
+
+/// A fixed set of `std::thread` workers that share the tasks of every `run`
+/// by work stealing.
+///
+/// Every worker has its own deque of task indices, and `run` deals the tasks
+/// out to them in contiguous blocks, so neighbouring tasks (like tiles in
+/// Morton order) stay with one worker. A worker takes its own tasks from the
+/// front of its deque. Once it runs out it steals from the back of the
+/// others, the tasks their owners would get to last, so the workers that
+/// finish early take over the tail of the slow ones.
+class WorkStealingPool {
+public:
+    /// @param num_workers the number of threads, 0 for one per hardware thread
+    /// @param on_start called with its index by every worker when it starts,
+    ///        before it runs any task (to pin it to a CPU, for example)
+    explicit WorkStealingPool(const size_t num_workers = 0, const std::function<void(size_t)>& on_start = {});
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    auto operator=(const WorkStealingPool&) -> WorkStealingPool& = delete;
+
+    /// @returns the number of worker threads
+    [[nodiscard]] auto num_workers() const noexcept -> size_t { return workers_.size(); }
+
+    /// Calls `task(i)` for every `i` in `[0, num_tasks)` on the workers and
+    /// waits for all of them. Only one run can be in flight at a time.
+    auto run(const size_t num_tasks, const std::function<void(size_t)>& task) -> void;
+
+    /// @returns how every worker spent the last `run`
+    [[nodiscard]] auto stats() const noexcept -> const std::vector<WorkerStats>& { return stats_; }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    auto work(const size_t worker, const std::function<void(size_t)> on_start) -> void;
+    /// Takes the next task from the front of the worker's own queue
+    auto take(const size_t worker, size_t& task) -> bool;
+    /// Takes the last task from the back of another worker's queue
+    auto steal(const size_t worker, size_t& task) -> bool;
+
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<WorkerStats> stats_;
+
+    const std::function<void(size_t)>* task_{nullptr};
+
+    // Starting and finishing a run
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    uint64_t generation_{0};
+    size_t running_{0};
+    bool stopping_{false};
+};
@@ -0,0 +1,141 @@
+#include "tiling.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <queue>
+
+#if __has_include(<unistd.h>)
+#include <unistd.h>
+#endif
+
+auto morton_tiles(const size_t width, const size_t height, const size_t tile_size) -> std::vector<Tile>
+{
+    if (width == 0 || height == 0 || tile_size == 0) { return {}; }
+
+    const size_t tiles_x = (width + tile_size - 1) / tile_size;
+    const size_t tiles_y = (height + tile_size - 1) / tile_size;
+
+    std::vector<std::pair<uint64_t, Tile>> tiles;
+    tiles.reserve(tiles_x * tiles_y);
+    for (size_t ty = 0; ty < tiles_y; ++ty) {
+        for (size_t tx = 0; tx < tiles_x; ++tx) {
+            const size_t x = tx * tile_size;
+            const size_t y = ty * tile_size;
+            tiles.emplace_back(
+                morton_code(static_cast<uint32_t>(tx), static_cast<uint32_t>(ty)),
+                Tile{x, std::min(x + tile_size, width), y, std::min(y + tile_size, height)});
+        }
+    }
+
+    // The codes of a grid that isn't a power of two in size have gaps, but
+    // they are still in Z order
+    std::sort(tiles.begin(), tiles.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::vector<Tile> ordered;
+    ordered.reserve(tiles.size());
+    for (const auto& [code, tile] : tiles) {
+        ordered.push_back(tile);
+    }
+    return ordered;
+}
+
+auto l2_cache_bytes() -> size_t
+{
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    const long bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (bytes > 0) { return static_cast<size_t>(bytes); }
+#endif
+
+    return size_t{1} << 20;
+}
+
+auto cache_tile_size(const int radius, const size_t cache_bytes) -> size_t
+{
+    constexpr size_t MinTileSize = 8;
+
+    // The side of the largest square of 16 bit heights in half of the cache
+    const auto side = static_cast<size_t>(std::sqrt(static_cast<double>(cache_bytes / 2 / sizeof(int16_t))));
+    const auto reach = 2 * static_cast<size_t>(std::max(radius, 0));
+
+    if (side < reach + MinTileSize) { return MinTileSize; }
+    return (side - reach) / MinTileSize * MinTileSize;
+}
+
+auto estimate_tile_cost(
+    const Tile& tile,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    const size_t samples) -> double
+{
+    const size_t tile_width = tile.x_end - tile.x_begin;
+    const size_t tile_height = tile.y_end - tile.y_begin;
+    if (tile_width == 0 || tile_height == 0) { return 0.0; }
+
+    const size_t count = std::max<size_t>(samples, 1);
+    double total = 0.0;
+
+    for (size_t sy = 0; sy < count; ++sy) {
+        for (size_t sx = 0; sx < count; ++sx) {
+            // The centers of a `count` by `count` grid over the tile
+            const auto x = static_cast<int64_t>(tile.x_begin + (2 * sx + 1) * tile_width / (2 * count));
+            const auto y = static_cast<int64_t>(tile.y_begin + (2 * sy + 1) * tile_height / (2 * count));
+            const auto current_height = static_cast<float>(static_cast<uint16_t>(height_map[static_cast<size_t>(y) * width + static_cast<size_t>(x)]));
+
+            for (size_t ray = 0; ray < stencil.num_rays(); ++ray) {
+                float max_angle_seen = -std::numeric_limits<float>::infinity();
+
+                for (size_t step = stencil.ray_begin(ray); step < stencil.ray_end(ray); ++step) {
+                    const int64_t curr_x = x + stencil.dx()[step];
+                    const int64_t curr_y = y + stencil.dy()[step];
+                    if (curr_x < 0 || curr_x >= static_cast<int64_t>(width) ||
+                        curr_y < 0 || curr_y >= static_cast<int64_t>(height)) {
+                        break;
+                    }
+
+                    const auto point_height = static_cast<float>(static_cast<uint16_t>(height_map[static_cast<size_t>(curr_y) * width + static_cast<size_t>(curr_x)]));
+                    const float angle = (point_height - current_height) * stencil.inv_dist()[step];
+
+                    total += 1.0;
+                    if (angle > max_angle_seen) {
+                        max_angle_seen = angle;
+                        total += NewHorizonCost;
+                    }
+                }
+            }
+        }
+    }
+
+    return total / static_cast<double>(count * count) * static_cast<double>(tile_width * tile_height);
+}
+
+auto lpt_assignment(const std::vector<double>& costs, const size_t num_workers) -> std::vector<std::vector<size_t>>
+{
+    std::vector<std::vector<size_t>> assignment(std::max<size_t>(num_workers, 1));
+
+    std::vector<size_t> order(costs.size());
+    std::iota(order.begin(), order.end(), size_t{0});
+    std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) { return costs[a] > costs[b]; });
+
+    // The least loaded worker on top, the lower index one on a tie
+    using Load = std::pair<double, size_t>;
+    std::priority_queue<Load, std::vector<Load>, std::greater<>> loads;
+    for (size_t worker = 0; worker < assignment.size(); ++worker) {
+        loads.emplace(0.0, worker);
+    }
+
+    for (const size_t tile : order) {
+        const auto [load, worker] = loads.top();
+        loads.pop();
+        assignment[worker].push_back(tile);
+        loads.emplace(load + costs[tile], worker);
+    }
+
+    for (auto& tiles : assignment) {
+        std::sort(tiles.begin(), tiles.end());
+    }
+    return assignment;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "ray_stencil.hpp"
+#include <span.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// A rectangle of observers, `[x_begin, x_end)` by `[y_begin, y_end)`
+struct Tile {
+    size_t x_begin;
+    size_t x_end;
+    size_t y_begin;
+    size_t y_end;
+};
+
+/// @returns the bits of `x` and `y` interleaved, `x` in the even bits
+[[nodiscard]]
+constexpr auto morton_code(const uint32_t x, const uint32_t y) -> uint64_t
+{
+    // Spreads the 32 bits of `v` out over the even bits of the result
+    const auto spread = [](uint64_t v) {
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+        v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+        v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+        v = (v | (v << 2)) & 0x3333333333333333ull;
+        v = (v | (v << 1)) & 0x5555555555555555ull;
+        return v;
+    };
+
+    return spread(x) | (spread(y) << 1);
+}
+
+/// Cuts a `width` by `height` map into square tiles of `tile_size` observers
+/// (smaller at the right and bottom edges).
+///
+/// The tiles are in Morton (Z) order of their position, so tiles that are
+/// next to each other in the list are mostly next to each other on the map
+/// too and share most of the heights around them. Handing them out to the
+/// threads in this order keeps the heights that neighbouring threads read
+/// close together.
+/// @returns the tiles, or none if the map or the tile size is empty
+[[nodiscard]]
+auto morton_tiles(const size_t width, const size_t height, const size_t tile_size) -> std::vector<Tile>;
+
+/// @returns the size of the level 2 cache of this CPU in bytes, or a guess of
+///          1 MiB if the system doesn't say
+[[nodiscard]]
+auto l2_cache_bytes() -> size_t;
+
+/// @returns the largest tile size (a multiple of 8) whose observers read a
+///          square of heights, the tile plus `radius` on every side, that
+///          fits into half of `cache_bytes`. The other half is left for the
+///          output and the ray tables. Never less than 8.
+[[nodiscard]]
+auto cache_tile_size(const int radius, const size_t cache_bytes) -> size_t;
+
+/// The extra cost, in ray steps, of a step that finds a new highest angle.
+/// Those are the branches of the visibility kernels that can't be predicted.
+constexpr double NewHorizonCost = 4.0;
+
+/// Estimates how much work the observers of `tile` are, in ray steps.
+///
+/// `samples` by `samples` observers spread evenly over the tile are walked
+/// like `single_pixel_visiblity` walks them, counting every step. Rays stop
+/// at the edge of the map, so tiles near the border cost less, and every new
+/// highest angle adds `NewHorizonCost` for the rugged terrain. The mean of
+/// the samples is scaled up to the whole tile.
+/// @param samples the number of sampled observers along each side, at least 1
+[[nodiscard]]
+auto estimate_tile_cost(
+    const Tile& tile,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    const size_t samples = 3) -> double;
+
+/// Assigns every tile to one of `num_workers` workers, longest processing time
+/// first: the tiles are taken from the most to the least expensive, and each
+/// one goes to the worker with the least work so far.
+/// @param costs the estimated cost of every tile
+/// @returns the tiles of every worker, in increasing order so that they keep
+///          the order of `morton_tiles`
+[[nodiscard]]
+auto lpt_assignment(const std::vector<double>& costs, const size_t num_workers) -> std::vector<std::vector<size_t>>;
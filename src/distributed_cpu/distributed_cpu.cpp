@@ -2,68 +2,177 @@
 #include <fmt/core.h>
 #include <cmath>
 #include <iostream>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <tuple>
 #include <utility>
 
-auto Get_arg(int argc, char** argv, const int rank) -> std::tuple<int, int, int> {
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+namespace {
+    /// @returns true on the thread that called `main`
+    auto is_main_thread() -> bool
+    {
+#ifdef _OPENMP
+        return omp_get_thread_num() == 0;
+#else
+        return true;
+#endif
+    }
+}
+
+auto Get_arg(int argc, char** argv, const int rank) -> Arguments {
     // initial parameters to the error state
-    int width{-1}, height{-1}, angle{-1};
+    Arguments args;
 
     // if the rank is 0 then parse the arguments and print the usage if
     // the arguments are incorrect
     if (rank == 0) {
-        if (argc == 6) {
-            width = std::stoi(argv[3]);
-            height = std::stoi(argv[4]);
-            angle = std::stoi(argv[5]);
+        if (argc >= 6) {
+            args.width = std::stoi(argv[3]);
+            args.height = std::stoi(argv[4]);
+            args.angle = std::stoi(argv[5]);
+            args.fixed_slopes = 0;
+            args.threads = 1;
+            args.blocks_2d = 0;
+            bool dynamic = false;
+            int chunk_rows = -1;
+
+            for (int i = 6; i < argc; ++i) {
+                const std::string option = argv[i];
+                if (option == "--slope=float") {
+                    args.fixed_slopes = 0;
+                } else if (option == "--slope=fixed") {
+                    args.fixed_slopes = 1;
+                } else if (option.rfind("--threads=", 0) == 0 && option.size() > 10 &&
+                           option.find_first_not_of("0123456789", 10) == std::string::npos) {
+                    args.threads = std::stoi(option.substr(10));
+                } else if (option == "--decomposition=rows") {
+                    args.blocks_2d = 0;
+                } else if (option == "--decomposition=2d") {
+                    args.blocks_2d = 1;
+                } else if (option == "--schedule=static" || option == "--schedule=dynamic") {
+                    dynamic = option == "--schedule=dynamic";
+                } else if (option.rfind("--chunk=", 0) == 0 && option.size() > 8 &&
+                           option.find_first_not_of("0123456789", 8) == std::string::npos) {
+                    chunk_rows = std::stoi(option.substr(8));
+                } else {
+                    std::cerr << "Unknown option " << option << ", expected --slope=<float|fixed>, --threads=<n>, "
+                              << "--decomposition=<rows|2d>, --schedule=<static|dynamic> or --chunk=<rows>" << std::endl;
+                    args.fixed_slopes = -1;
+                }
+            }
+
+            // The chunks are bands of whole rows. Without `--chunk` main picks
+            // their size once it knows the threads of every rank.
+            args.dynamic = dynamic ? 1 : 0;
+            args.chunk_rows = dynamic ? std::max(chunk_rows, 0) : 0;
+            if (dynamic && (chunk_rows == 0 || args.blocks_2d == 1)) {
+                std::cerr << "--schedule=dynamic needs --chunk=<rows> of at least 1 and --decomposition=rows" << std::endl;
+                args.chunk_rows = -1;
+            }
         } else {
-            std::cerr << "Usage: " << argv[0] << " <read_file> <write_file> <width> <height> <angle>" << std::endl;
+            std::cerr << "Usage: " << argv[0] << " <read_file> <write_file> <width> <height> <angle> [--slope=<float|fixed>] [--threads=<n>] [--decomposition=<rows|2d>]"
+                      << " [--schedule=<static|dynamic>] [--chunk=<rows>]" << std::endl;
         }
     }
     
-    return {width, height, angle};
+    return args;
+}
+
+auto map_block(const std::array<int, 2> coords, const std::array<int, 2> dims,
+               const int width, const int height, const int radius) -> Block {
+    // Part `index` of `parts` of `[0, length)`. The first `length % parts`
+    // parts are one longer than the others.
+    const auto split = [](const int index, const int parts, const int length) -> std::pair<int, int> {
+        const int per_part = length / parts;
+        const int remaining = length % parts;
+        const int begin = index * per_part + std::min(index, remaining);
+        return {begin, begin + per_part + (index < remaining ? 1 : 0)};
+    };
+
+    Block block;
+    std::tie(block.start_row, block.end_row) = split(coords[0], dims[0], height);
+    std::tie(block.start_col, block.end_col) = split(coords[1], dims[1], width);
+    block.halo_top = std::max(block.start_row - radius, 0);
+    block.halo_bottom = std::min(block.end_row + radius, height);
+    block.halo_left = std::max(block.start_col - radius, 0);
+    block.halo_right = std::min(block.end_col + radius, width);
+    return block;
+}
+
+auto row_chunk(const int chunk, const int chunk_rows,
+               const int width, const int height, const int radius) -> Block {
+    Block block;
+    block.start_row = std::min(chunk * chunk_rows, height);
+    block.end_row = std::min(block.start_row + chunk_rows, height);
+    block.start_col = 0;
+    block.end_col = width;
+    block.halo_top = std::max(block.start_row - radius, 0);
+    block.halo_bottom = std::min(block.end_row + radius, height);
+    block.halo_left = 0;
+    block.halo_right = width;
+    return block;
+}
+
+auto report_rank_stats(const std::vector<RankStats>& stats) -> void {
+    for (size_t rank = 0; rank < stats.size(); ++rank) {
+        fmt::println("  Rank {:>3}: {:>5} chunks, busy {:>8.0f} ms, idle {:>8.0f} ms",
+            rank, static_cast<int>(stats[rank].chunks), stats[rank].busy_ms, stats[rank].idle_ms);
+    }
 }
 
 // Function to calculate visibility for a portion of the map
 auto calculateVisibilityLocal(
-    const std::vector<int16_t>& height_map, 
-    const int width, const int height, 
-    const int start_y, const int end_y, const int rank,
-    const int radius, const int num_angles) -> std::vector<unsigned int> {
-    
-    std::vector<unsigned int> local_visibility(width * (end_y - start_y), 0);
-    const int radius_squared = radius * radius;
+    const tcb::span<const int16_t> heights, 
+    const Block& block, const bool show_progress,
+    const int radius, const int num_angles,
+    const SlopeMode slope,
+    const std::function<void()>& between_rows) -> huge_vector<unsigned int> {
     
-    // the distance in radians between reach angle
-    const double angle_step = 2 * M_PI / num_angles;
+    const int width = block.cols();
+    huge_vector<unsigned int> local_visibility(static_cast<size_t>(width) * static_cast<size_t>(block.rows()), 0);
     
-    std::vector<std::pair<float, float>> ray_directions;
-    ray_directions.reserve(num_angles);
+    // The kernels see `heights` as the whole map. The halo holds every pixel
+    // that the rays of the block can reach, so they only stop early at the
+    // edges of the block where it is also the edge of the real map.
+    const auto local_width = static_cast<size_t>(block.halo_cols());
+    const auto local_height = static_cast<size_t>(block.halo_rows());
+    const auto x_begin = static_cast<size_t>(block.start_col - block.halo_left);
+    const auto x_end = static_cast<size_t>(block.end_col - block.halo_left);
+
+    // precalculate the rays to be cast
+    const RayStencil stencil(radius, num_angles);
     
-    // precalculate the angle of the rays to be cast
-    for (int i = 0; i < num_angles; ++i) {
-        double angle = i * angle_step;
-        float dx = std::cos(angle) * radius;
-        float dy = std::sin(angle) * radius;
-        ray_directions.push_back({dx, dy});
-    }
+    // Observers far enough from the edges can skip the bounds checks
+    const auto interior = interior_region(stencil, local_width, local_height);
     
-    // Process each pixel in assigned range
-    for (int y = start_y; y < end_y; ++y) {
-        for (int x = 0; x < width; ++x) {
-            // Print progress more frequently
-            if ((y * width + x) % 1000 == 0 && rank == 0) {
-                std::cout << "\r" << (static_cast<float>((y - start_y) * width + x) / (width * (end_y - start_y))) * 100 << "%";
-                std::cout.flush();
-            }
-            
-            // Store the visibility count in the local map
-            local_visibility[(y - start_y) * width + x] = single_pixel_visiblity(
-                x, y, width, height, radius, radius_squared, height_map, ray_directions
-            );
+    // The rows of the block are shared by the threads of this rank
+    std::atomic<int> rows_done{0};
+
+    // Process each row in assigned range
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int y = block.start_row; y < block.end_row; ++y) {
+        // Print progress once per row, from the thread that's allowed to
+        // (only the main thread writes to the console)
+        const int done = rows_done++;
+        if (show_progress && is_main_thread()) {
+            std::cout << "\r" << (static_cast<float>(done) / static_cast<float>(block.rows())) * 100 << "%";
+            std::cout.flush();
         }
+        
+        // Store the visibility counts in the local map
+        const auto local_y = static_cast<size_t>(y - block.halo_top);
+        unsigned int* output = &local_visibility[static_cast<size_t>(y - block.start_row) * static_cast<size_t>(width)];
+        row_visibility(local_y, x_begin, x_end, local_width, local_height, heights, stencil, interior, output, slope);
+
+        if (between_rows && is_main_thread()) { between_rows(); }
     }
 
-    if(rank == 0)
+    if (show_progress)
         std::cout << "\r100% Complete" << std::endl;
 
     return local_visibility;
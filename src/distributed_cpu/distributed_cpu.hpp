@@ -1,30 +1,116 @@
 #pragma once
 
+#include <array>
+#include <functional>
 #include <vector>
 #include <cstdint>
-#include <tuple>
 #include "core.hpp"
 
+/// The command line arguments of `dist_cpu`. Any that are invalid are less
+/// than or equal to zero (less than zero for `fixed_slopes` and `threads`).
+struct Arguments {
+    int width{-1};
+    int height{-1};
+    int angle{-1};
+    /// 1 for `--slope=fixed` and 0 otherwise
+    int fixed_slopes{-1};
+    /// The OpenMP threads of every rank (`--threads=<n>`, 1 by default), 0
+    /// for one per core the rank may run on
+    int threads{-1};
+    /// 1 for `--decomposition=2d` (blocks on a 2D grid of processes) and 0
+    /// for `--decomposition=rows` (bands of rows, the default)
+    int blocks_2d{-1};
+    /// 1 for `--schedule=dynamic` (chunks of rows claimed at run time) and 0
+    /// for `--schedule=static` (a block per process, the default)
+    int dynamic{-1};
+    /// The rows of every chunk of `--schedule=dynamic` (`--chunk=<rows>`), 0
+    /// for as many as the threads of a rank or the radius, whichever is more
+    int chunk_rows{-1};
+};
+
 /// @brief Parses the command line arguments
 /// @param argc argc from main
 /// @param argv argv from main
 /// @param rank rank from MPI
-/// @return [width, height, angle] if any are invalid they will be less than
-///         or equal to zero.
-auto Get_arg(int argc, char** argv, const int rank) -> std::tuple<int, int, int>;
+/// @return the arguments, only parsed on rank 0 (the others get the
+///         invalid defaults)
+auto Get_arg(int argc, char** argv, const int rank) -> Arguments;
+
+/// The part of the map that one process works on and reads
+struct Block {
+    /// The pixels it calculates, rows `[start_row, end_row)` of columns
+    /// `[start_col, end_col)`
+    int start_row;
+    int end_row;
+    int start_col;
+    int end_col;
+    /// The pixels it reads: its own and `radius` more on every side (fewer at
+    /// the edges of the map), rows `[halo_top, halo_bottom)` of columns
+    /// `[halo_left, halo_right)`
+    int halo_top;
+    int halo_bottom;
+    int halo_left;
+    int halo_right;
+
+    [[nodiscard]] auto rows() const -> int { return end_row - start_row; }
+    [[nodiscard]] auto cols() const -> int { return end_col - start_col; }
+    [[nodiscard]] auto halo_rows() const -> int { return halo_bottom - halo_top; }
+    [[nodiscard]] auto halo_cols() const -> int { return halo_right - halo_left; }
+};
 
-/// @brief Calculates the visible of a portion of the map
-/// @param height_map the global height map
+/// @brief Divides the map evenly into a grid of blocks, one per process
+/// @param coords the (row, column) of the process in the grid
+/// @param dims the number of (rows, columns) of the grid. `{comm_sz, 1}`
+///        gives every process a band of whole rows.
 /// @param width the width of the global height map
 /// @param height the height of the global height map
-/// @param start_y the y-value (row) to start on for this process
-/// @param end_y the y-value (row) to end for this process
-/// @param rank the rank of this process
+/// @param radius how far the rays reach
+/// @return the block of the process at `coords`
+auto map_block(const std::array<int, 2> coords, const std::array<int, 2> dims,
+               const int width, const int height, const int radius) -> Block;
+
+/// @brief The rows of one chunk of `--schedule=dynamic`
+/// @param chunk the index of the chunk
+/// @param chunk_rows the rows of every chunk (the last one can be shorter)
+/// @param width the width of the global height map
+/// @param height the height of the global height map
+/// @param radius how far the rays reach
+/// @return the block of whole rows of `chunk`
+auto row_chunk(const int chunk, const int chunk_rows,
+               const int width, const int height, const int radius) -> Block;
+
+/// How one process spent its run. Only doubles, so that they can be gathered
+/// as `MPI_DOUBLE`s.
+struct RankStats {
+    /// The blocks or chunks that it calculated
+    double chunks{0.0};
+    /// The time it spent calculating them
+    double busy_ms{0.0};
+    /// The time it waited for the others once it ran out of work
+    double idle_ms{0.0};
+};
+
+/// @brief Prints how many chunks every process calculated and how long it was
+///        busy and idle
+auto report_rank_stats(const std::vector<RankStats>& stats) -> void;
+
+/// @brief Calculates the visible of a portion of the map. The rows are
+///        shared by the OpenMP threads of this rank.
+/// @param heights the pixels of the global height map that this process reads
+///        (its block and halo), `block.halo_rows()` rows of
+///        `block.halo_cols()` heights
+/// @param block the block of this process
+/// @param show_progress print how many of the rows are done
 /// @param radius the radius of the circle to calculate
 /// @param num_angles the number of angles (rays) to cast
-/// @return the local visibility map for this process
+/// @param slope how the vertical angles are compared
+/// @param between_rows called by the main thread after each of its rows, e.g.
+///        to let MPI make progress while the rank calculates
+/// @return the local visibility map for this process, `block.rows()` rows of
+///         `block.cols()` counts
 auto calculateVisibilityLocal(
-    const std::vector<int16_t>& height_map, 
-    const int width, const int height, 
-    const int start_y, const int end_y, const int rank,
-    const int radius, const int num_angles) -> std::vector<unsigned int>;
\ No newline at end of file
+    const tcb::span<const int16_t> heights, 
+    const Block& block, const bool show_progress,
+    const int radius, const int num_angles,
+    const SlopeMode slope = SlopeMode::floating,
+    const std::function<void()>& between_rows = {}) -> huge_vector<unsigned int>;
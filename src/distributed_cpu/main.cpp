@@ -15,18 +15,27 @@
 #include <iterator> // For std::istreambuf_iterator
 #include <cstdlib> // For std::abs
 #include <cstring> // For std::memcpy
+#include <array>
+#include <chrono>
+#include <utility>
 
 #include "distributed_cpu.hpp"
 #include "core.hpp"
 #include <mpi.h>
 
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
 // Globals
 int my_rank, comm_sz;
 MPI_Comm comm;
 constexpr int RADIUS = 100;
 
 int main(int argc, char** argv) {
-    MPI_Init(&argc, &argv);
+    // Every rank can run OpenMP threads, but only its main thread calls MPI
+    int thread_support;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_support);
     
     // MPI specific initialization
     int initialized;
@@ -36,16 +45,21 @@ int main(int argc, char** argv) {
     MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
     
     // Parse command line arguments
-    auto [width, height, angle] = Get_arg(argc, argv, my_rank);
+    auto [width, height, angle, fixed_slopes, threads, blocks_2d, dynamic, chunk_rows] = Get_arg(argc, argv, my_rank);
 
     // Broadcast all parameters across processes
     MPI_Bcast(&width, 1, MPI_INT, 0, MPI_COMM_WORLD);
     MPI_Bcast(&height, 1, MPI_INT, 0, MPI_COMM_WORLD);
     MPI_Bcast(&angle, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&fixed_slopes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&threads, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&blocks_2d, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&dynamic, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&chunk_rows, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
     // Validate input arguments. Each process does this so that they all 
     // can exit if the arguments are invalid.
-    if (width <= 0 || height <= 0 || angle <= 0) {
+    if (width <= 0 || height <= 0 || angle <= 0 || fixed_slopes < 0 || threads < 0 || blocks_2d < 0 || dynamic < 0 || chunk_rows < 0) {
         if (my_rank == 0)
             std::cout << "Invalid input arguments, exiting." << std::endl;
 
@@ -53,80 +67,312 @@ int main(int argc, char** argv) {
         MPI_Finalize();
         return 1;
     }
-       
-    // Every proces gets it's own height map
-    std::vector<int16_t> height_map;
-    
-    // Only rank 0 reads the input file
+
+    // Run one rank per node (or socket) with a thread per core, or one rank
+    // per core with a single thread. 0 threads leaves it to OpenMP, which
+    // uses the cores the rank is bound to.
+#ifdef _OPENMP
+    if (threads > 0) { omp_set_num_threads(threads); }
+    const int rank_threads = omp_get_max_threads();
+#else
+    const int rank_threads = 1;
+#endif
     if (my_rank == 0) {
+        fmt::println("Ranks: {} x {} thread(s){}", comm_sz, rank_threads,
+            rank_threads > 1 && thread_support < MPI_THREAD_FUNNELED ? " (MPI doesn't support funneled threads)" : "");
+    }
+       
+    // Every process gets its part of the height map (one chunk at a time
+    // for the dynamic chunks), and rank 0 gets the whole output
+    huge_vector<int16_t> height_map;
+    huge_vector<unsigned int> visibility_map;
+    const SlopeMode slope = fixed_slopes ? SlopeMode::fixed : SlopeMode::floating;
+    timer time;
+    RankStats stats;
+
+    // Whether the kernel found huge pages for the height map that rank 0
+    // read, which the static schedule drops once it sent out the blocks
+    HugePageUsage map_pages;
+
+    // Reads the height map on rank 0
+    const auto read_map = [&]() {
         // Display inputs
         printf("Parameters: width=%d, height=%d, angle=%d\n", width, height, angle);
         
         // Read height map
-        height_map = read_input(argv[1]);
+        auto global_map = read_input<huge_page_allocator<int16_t>>(argv[1]);
         std::cout << "Height map loaded: " << width << "x" << height << std::endl;
-    }
-    
-    // Resize height_map vector on all non-root processes
-    if (my_rank != 0) {
-        height_map.resize(width * height);
-    }
-    
-    // Broadcast the entire height map to all processes
-    MPI_Bcast(height_map.data(), width * height, MPI_UNSIGNED_SHORT, 0, MPI_COMM_WORLD);
-    
-    // Initialize visibility map on root process
-    std::vector<unsigned int> visibility_map;
-    if (my_rank == 0) {
-        visibility_map.resize(width * height, 0);
-    }
+        if (global_map.size() != static_cast<size_t>(width) * static_cast<size_t>(height)) {
+            std::cout << "Height map has " << global_map.size() << " values instead of " << width * height << ", exiting." << std::endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        map_pages = huge_page_usage(global_map.data(), global_map.size() * sizeof(int16_t));
+        return global_map;
+    };
 
-     // Time the algorithm. Only the rank 0 process actually prints this
-     timer time;
-     time.reset();
-    
-    // Divide work by rows
-    int rows_per_proc = height / comm_sz;
-    int remaining_rows = height % comm_sz;
+    if (dynamic) {
+        // By default a chunk has a row for every thread of the busiest rank,
+        // and at least as many rows as the halo it reads above and below them
+        if (chunk_rows == 0) {
+            int most_threads = rank_threads;
+            MPI_Allreduce(&rank_threads, &most_threads, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+            chunk_rows = std::max(most_threads, RADIUS);
+        }
+        const int num_chunks = (height + chunk_rows - 1) / chunk_rows;
+
+        // Rank 0 keeps the whole map and the whole output, and every rank
+        // (rank 0 too) claims chunks and calculates them
+        if (my_rank == 0) {
+            height_map = read_map();
+            visibility_map.resize(static_cast<size_t>(width) * static_cast<size_t>(height), 0);
+            size_t halo_rows = 0;
+            for (int chunk = 0; chunk < num_chunks; ++chunk) {
+                halo_rows += static_cast<size_t>(row_chunk(chunk, chunk_rows, width, height, RADIUS).halo_rows());
+            }
+            fmt::println("Dynamic schedule: {} chunks of {} rows, the halos add {:.0f}% to the heights read",
+                num_chunks, chunk_rows, (static_cast<double>(halo_rows) / static_cast<double>(height) - 1.0) * 100.0);
+        }
+
+        // Time the algorithm. Only the rank 0 process actually prints this
+        time.reset();
+
+        // Rank 0 exposes the index of the next chunk, its height map and its
+        // output, the others expose nothing. A single rank needs no windows
+        // (and MPI may not have them without a second process).
+        const bool shared = comm_sz > 1;
+        int next_chunk = 0;
+        MPI_Win counter;
+        MPI_Win heights;
+        MPI_Win output;
+        if (shared) {
+            MPI_Win_create(&next_chunk, my_rank == 0 ? sizeof(int) : 0, sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &counter);
+            MPI_Win_create(height_map.data(), static_cast<MPI_Aint>(height_map.size() * sizeof(int16_t)), sizeof(int16_t),
+                           MPI_INFO_NULL, MPI_COMM_WORLD, &heights);
+            MPI_Win_create(visibility_map.data(), static_cast<MPI_Aint>(visibility_map.size() * sizeof(unsigned int)), sizeof(unsigned int),
+                           MPI_INFO_NULL, MPI_COMM_WORLD, &output);
+            MPI_Win_lock_all(0, counter);
+            MPI_Win_lock_all(0, heights);
+            MPI_Win_lock_all(0, output);
+        }
+
+        // Claims the next chunk
+        const auto claim = [&]() {
+            if (!shared) { return next_chunk++; }
+            const int one = 1;
+            int chunk = 0;
+            MPI_Fetch_and_op(&one, &chunk, MPI_INT, 0, 0, MPI_SUM, counter);
+            MPI_Win_flush(0, counter);
+            return chunk;
+        };
+
+        // Starts getting the rows of `chunk` and their halo into `buffer`.
+        // Rank 0 reads them from its own map instead.
+        const auto prefetch = [&](const int chunk, huge_vector<int16_t>& buffer) {
+            MPI_Request request = MPI_REQUEST_NULL;
+            if (chunk < num_chunks && my_rank != 0) {
+                const Block block = row_chunk(chunk, chunk_rows, width, height, RADIUS);
+                buffer.resize(static_cast<size_t>(block.halo_rows()) * static_cast<size_t>(width));
+                MPI_Rget(buffer.data(), static_cast<int>(buffer.size()), MPI_UNSIGNED_SHORT,
+                         0, static_cast<MPI_Aint>(block.halo_top) * width, static_cast<int>(buffer.size()), MPI_UNSIGNED_SHORT, heights, &request);
+            }
+            return request;
+        };
+
+        // The heights that the rays of a chunk read
+        const auto chunk_heights = [&](const Block& block, const huge_vector<int16_t>& buffer) {
+            if (my_rank != 0) { return tcb::span<const int16_t>(buffer); }
+            return tcb::span<const int16_t>(height_map).subspan(
+                static_cast<size_t>(block.halo_top) * static_cast<size_t>(width),
+                static_cast<size_t>(block.halo_rows()) * static_cast<size_t>(width));
+        };
+
+        // The main thread looks for messages between its rows, which is enough
+        // for MPI to serve the one sided operations of the other ranks even
+        // where it only does that while the target calls into it
+        const auto poll = []() {
+            int flag = 0;
+            MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, MPI_STATUS_IGNORE);
+        };
+
+        // Every chunk gets the heights of the next one while it's calculated,
+        // and puts its counts straight into rank 0's output while the next one
+        // is
+        std::array<huge_vector<int16_t>, 2> buffers;
+        huge_vector<unsigned int> sent;
+        MPI_Request put_request = MPI_REQUEST_NULL;
+        int chunk = claim();
+        MPI_Request get_request = prefetch(chunk, buffers[0]);
+        for (size_t current = 0; chunk < num_chunks; current ^= 1) {
+            timer<std::chrono::microseconds> busy_time;
+            MPI_Wait(&get_request, MPI_STATUS_IGNORE);
+            const int next = claim();
+            get_request = prefetch(next, buffers[current ^ 1]);
+
+            const Block block = row_chunk(chunk, chunk_rows, width, height, RADIUS);
+            auto local_visibility = calculateVisibilityLocal(chunk_heights(block, buffers[current]), block, false, RADIUS, angle, slope, poll);
+            if (my_rank == 0) {
+                std::copy(local_visibility.begin(), local_visibility.end(),
+                          visibility_map.begin() + static_cast<ptrdiff_t>(block.start_row) * width);
+            } else {
+                MPI_Wait(&put_request, MPI_STATUS_IGNORE);
+                sent = std::move(local_visibility);
+                MPI_Rput(sent.data(), static_cast<int>(sent.size()), MPI_UNSIGNED,
+                         0, static_cast<MPI_Aint>(block.start_row) * width, static_cast<int>(sent.size()), MPI_UNSIGNED, output, &put_request);
+            }
+
+            stats.chunks += 1.0;
+            stats.busy_ms += static_cast<double>(busy_time.read()) / 1000.0;
+            chunk = next;
+        }
+
+        // The time until the last chunk of every process is in
+        timer<std::chrono::microseconds> idle_time;
+        MPI_Wait(&put_request, MPI_STATUS_IGNORE);
+        if (shared) {
+            MPI_Win_unlock_all(output);
+            MPI_Win_unlock_all(heights);
+            MPI_Win_unlock_all(counter);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        stats.idle_ms = static_cast<double>(idle_time.read()) / 1000.0;
+
+        if (shared) {
+            MPI_Win_free(&output);
+            MPI_Win_free(&heights);
+            MPI_Win_free(&counter);
+        }
+    } else {
+        // Lay the processes out on a grid: a column of bands of rows, or the
+        // closest to square grid with more rows of blocks if the map is taller
+        // than it is wide (and more columns if it's wider). The ranks stay the
+        // same so that rank 0 is still the one that reads and writes.
+        std::array<int, 2> dims{comm_sz, 1};
+        if (blocks_2d) {
+            dims = {0, 0};
+            MPI_Dims_create(comm_sz, 2, dims.data());
+            if (width > height) { std::swap(dims[0], dims[1]); }
+        }
+        const std::array<int, 2> periods{0, 0};
+        MPI_Comm grid;
+        MPI_Cart_create(MPI_COMM_WORLD, 2, dims.data(), periods.data(), 0, &grid);
+
+        // The block of process `rank`
+        const auto block_of = [&](const int rank) {
+            std::array<int, 2> coords{};
+            MPI_Cart_coords(grid, rank, 2, coords.data());
+            return map_block(coords, dims, width, height, RADIUS);
+        };
+
+        // The type of `rows` rows of `cols` elements of `type` in a map that
+        // is `width` wide
+        const auto block_type = [&](const int rows, const int cols, const MPI_Datatype type) {
+            MPI_Datatype vector_type;
+            MPI_Type_vector(rows, cols, width, type, &vector_type);
+            MPI_Type_commit(&vector_type);
+            return vector_type;
+        };
+
+        // The pixels of this process, and the ones its rays reach
+        const Block block = block_of(my_rank);
+
+        // Every process gets its own block of the height map, with the halo
+        // around it
+        height_map.resize(static_cast<size_t>(block.halo_rows()) * static_cast<size_t>(block.halo_cols()));
     
-    // Calculate start and end rows for each process
-    int start_row = my_rank * rows_per_proc + std::min(my_rank, remaining_rows);
-    int end_row = start_row + rows_per_proc + (my_rank < remaining_rows ? 1 : 0);
+        // Only rank 0 reads the input file
+        if (my_rank == 0) {
+            const auto global_map = read_map();
+
+            // Send every other process just the pixels it reads. The halos of
+            // neighbouring blocks overlap, which Scatterv may not send, so they
+            // get a message each.
+            timer send_time;
+            size_t sent = 0;
+            size_t halo_pixels = 0;
+            std::vector<MPI_Request> requests(static_cast<size_t>(comm_sz - 1));
+            for (int i = 0; i < comm_sz; i++) {
+                const Block other = block_of(i);
+                halo_pixels += static_cast<size_t>(other.halo_rows()) * static_cast<size_t>(other.halo_cols());
+                if (i == 0) { continue; }
 
-    // Calculate local visibility
-    std::vector<unsigned int> local_visibility = calculateVisibilityLocal(
-        height_map, width, height, start_row, end_row, my_rank, RADIUS, angle);
+                MPI_Datatype halo_type = block_type(other.halo_rows(), other.halo_cols(), MPI_UNSIGNED_SHORT);
+                MPI_Isend(&global_map[static_cast<size_t>(other.halo_top) * static_cast<size_t>(width) + static_cast<size_t>(other.halo_left)], 1, halo_type,
+                          i, 0, MPI_COMM_WORLD, &requests[static_cast<size_t>(i - 1)]);
+                MPI_Type_free(&halo_type);
+                sent += static_cast<size_t>(other.halo_rows()) * static_cast<size_t>(other.halo_cols()) * sizeof(int16_t);
+            }
+            for (int row = 0; row < block.halo_rows(); ++row) {
+                std::copy_n(&global_map[static_cast<size_t>(block.halo_top + row) * static_cast<size_t>(width) + static_cast<size_t>(block.halo_left)],
+                            block.halo_cols(), &height_map[static_cast<size_t>(row) * static_cast<size_t>(block.halo_cols())]);
+            }
+            MPI_Waitall(comm_sz - 1, requests.data(), MPI_STATUSES_IGNORE);
+
+            // A broadcast would have sent the whole map to every other process
+            const size_t broadcast = static_cast<size_t>(comm_sz - 1) * global_map.size() * sizeof(int16_t);
+            fmt::println("Process grid: {} x {} blocks of about {}x{} pixels, the halos add {:.0f}% to the heights read",
+                dims[0], dims[1], width / dims[1], height / dims[0],
+                (static_cast<double>(halo_pixels) / static_cast<double>(global_map.size()) - 1.0) * 100.0);
+            fmt::println("Height map blocks sent: {:.1f} MiB in {} ms ({:.1f} MiB as a broadcast)",
+                static_cast<double>(sent) / (1024.0 * 1024.0), send_time.read(), static_cast<double>(broadcast) / (1024.0 * 1024.0));
+        } else {
+            MPI_Recv(height_map.data(), static_cast<int>(height_map.size()), MPI_UNSIGNED_SHORT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
     
-    // Prepare for gathering results
-    std::vector<int> recv_counts;
-    std::vector<int> displacements;
+        // Initialize visibility map on root process
+        if (my_rank == 0) {
+            visibility_map.resize(static_cast<size_t>(width) * static_cast<size_t>(height), 0);
+        }
+
+        // Time the algorithm. Only the rank 0 process actually prints this
+        time.reset();
+
+        // Calculate local visibility
+        timer<std::chrono::microseconds> busy_time;
+        huge_vector<unsigned int> local_visibility = calculateVisibilityLocal(
+            height_map, block, my_rank == 0, RADIUS, angle, slope);
+        stats.chunks = 1.0;
+        stats.busy_ms = static_cast<double>(busy_time.read()) / 1000.0;
+
+        // The time until the slowest process is done too
+        timer<std::chrono::microseconds> idle_time;
+        MPI_Barrier(MPI_COMM_WORLD);
+        stats.idle_ms = static_cast<double>(idle_time.read()) / 1000.0;
     
-    // manually divide the work into rows,
-    // because scatterv wasn't working :'( 
-    // gatherv does, though... so you know.
-    if (my_rank == 0) {
-        recv_counts.resize(comm_sz);
-        displacements.resize(comm_sz);
-        
-        int disp = 0;
-        for (int i = 0; i < comm_sz; i++) {
-            int proc_rows = rows_per_proc + (i < remaining_rows ? 1 : 0);
-            recv_counts[i] = proc_rows * width;
-            displacements[i] = disp;
-            disp += recv_counts[i];
+        // Gather every block into its place in the root's map. Those aren't
+        // contiguous once the map is split into columns, so every block is
+        // received straight into its rows.
+        if (my_rank == 0) {
+            std::vector<MPI_Request> requests(static_cast<size_t>(comm_sz - 1));
+            for (int i = 1; i < comm_sz; i++) {
+                const Block other = block_of(i);
+                MPI_Datatype output_type = block_type(other.rows(), other.cols(), MPI_UNSIGNED);
+                MPI_Irecv(&visibility_map[static_cast<size_t>(other.start_row) * static_cast<size_t>(width) + static_cast<size_t>(other.start_col)], 1, output_type,
+                          i, 1, MPI_COMM_WORLD, &requests[static_cast<size_t>(i - 1)]);
+                MPI_Type_free(&output_type);
+            }
+            for (int row = 0; row < block.rows(); ++row) {
+                std::copy_n(&local_visibility[static_cast<size_t>(row) * static_cast<size_t>(block.cols())], block.cols(),
+                            &visibility_map[static_cast<size_t>(block.start_row + row) * static_cast<size_t>(width) + static_cast<size_t>(block.start_col)]);
+            }
+            MPI_Waitall(comm_sz - 1, requests.data(), MPI_STATUSES_IGNORE);
+        } else {
+            MPI_Send(local_visibility.data(), static_cast<int>(local_visibility.size()), MPI_UNSIGNED, 0, 1, MPI_COMM_WORLD);
         }
+        MPI_Comm_free(&grid);
     }
-    
-    // Gather all local visibility results to the root process
-    MPI_Gatherv(
-        local_visibility.data(), local_visibility.size(), MPI_UNSIGNED,
-        visibility_map.data(), recv_counts.data(), displacements.data(), MPI_UNSIGNED,
-        0, MPI_COMM_WORLD
-    );
-
-    // Display timing
+
+    // How evenly the work was spread
+    std::vector<RankStats> all_stats(my_rank == 0 ? static_cast<size_t>(comm_sz) : 0);
+    MPI_Gather(&stats, 3, MPI_DOUBLE, all_stats.data(), 3, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    // Display timing, and whether the kernel found huge pages for the big
+    // arrays of rank 0
     if (my_rank == 0) {
         fmt::println("Elapsed time: {} ms", time.read());
+        report_rank_stats(all_stats);
+        fmt::println("Huge pages: height map {}, output {}",
+            describe_huge_pages(map_pages),
+            describe_huge_pages(huge_page_usage(visibility_map.data(), visibility_map.size() * sizeof(unsigned int))));
     }
     
     // Write output
@@ -1,75 +1,51 @@
 #include "dist_gpu.cuh"
+#include "ray_casting.hpp"
 #include <cmath>
 #include <cuda_runtime.h>
 #include <iostream>
 #include <vector>
 #include "fmt/core.h"
 
-__global__ void calculate_visibility_kernel(
+// Counts the cells visible from (x, y). Observers in the interior of the map
+// can't cast a ray off of it, so the bounds checks are compiled out for them.
+template<bool CheckBounds>
+__device__ unsigned int count_visible(
     const int16_t *height_map,
-    unsigned int *visibility_map,
+    int x,
+    int y,
     int width,
     int height,
-    int radius,
-    int num_angles,
-    int y_offset,
-    int rank,
-    float *ray_directions_x,
-    float *ray_directions_y
+    int num_rays,
+    const unsigned int *ray_offsets,
+    const int *offsets_x,
+    const int *offsets_y,
+    const float *inv_dist
 )
 {
-    int x = blockIdx.x * blockDim.x + threadIdx.x;
-    int y = (blockIdx.y * blockDim.y + threadIdx.y) + y_offset;
-
-    // check bounds
-    if (x >= width || y >= height) { return; }
-
-    const int radius_squared = radius * radius;
-    const int index = y * width + x;
-    unsigned short current_height = height_map[index];
+    unsigned short current_height = height_map[y * width + x];
 
     // Start the count at this cell as 1 (the pixel itself is always visible)
     unsigned int visible_count = 1;
 
     // Cast rays in different directions
-    for (int i = 0; i < num_angles; ++i) {
-        float dx = ray_directions_x[i];
-        float dy = ray_directions_y[i];
-
-        int max_steps = radius;
+    for (int i = 0; i < num_rays; ++i) {
         float max_angle_seen = -INFINITY;
 
-        // Step size for more efficient ray traversal
-        const float ray_length = sqrtf(dx * dx + dy * dy);
-        const float step_x = dx / ray_length;
-        const float step_y = dy / ray_length;
-
-        float curr_x_f = x + 0.5f; // Start at center of pixel
-        float curr_y_f = y + 0.5f;
-
-        for (int step = 1; step <= max_steps; ++step) {
-            // Move along the ray
-            curr_x_f += step_x;
-            curr_y_f += step_y;
-
-            // Round to nearest pixel
-            const int curr_x = __float2int_rn(curr_x_f);
-            const int curr_y = __float2int_rn(curr_y_f);
+        // Every step of the ray is already inside of the radius, so only the
+        // map bounds need to be checked
+        for (unsigned int step = ray_offsets[i]; step < ray_offsets[i + 1]; ++step) {
+            const int curr_x = x + offsets_x[step];
+            const int curr_y = y + offsets_y[step];
 
             // Check bounds
-            if (curr_x < 0 || curr_x >= width || curr_y < 0 || curr_y >= height) break;
-
-            // Check if we've gone too far (outside the radius)
-            int dist_squared = (curr_x - x) * (curr_x - x) + (curr_y - y) * (curr_y - y);
-            if (dist_squared > radius_squared) break;
+            if (CheckBounds && (curr_x < 0 || curr_x >= width || curr_y < 0 || curr_y >= height)) break;
 
             // Get height at current position
             unsigned short point_height = height_map[curr_y * width + curr_x];
 
             // Calculate angle to determine visibility
-            float distance = sqrtf(static_cast<float>(dist_squared));
             float height_diff = static_cast<float>(point_height) - static_cast<float>(current_height);
-            float angle = height_diff / distance;
+            float angle = height_diff * inv_dist[step];
 
             // If the angle is greater than the maximum seen so far,
             // the pixel is visible
@@ -80,6 +56,40 @@ __global__ void calculate_visibility_kernel(
         }
     }
 
+    return visible_count;
+}
+
+__global__ void calculate_visibility_kernel(
+    const int16_t *height_map,
+    unsigned int *visibility_map,
+    int width,
+    int height,
+    int num_rays,
+    int y_offset,
+    int rank,
+    const unsigned int *ray_offsets,
+    const int *offsets_x,
+    const int *offsets_y,
+    const float *inv_dist,
+    int4 interior
+)
+{
+    int x = blockIdx.x * blockDim.x + threadIdx.x;
+    int y = (blockIdx.y * blockDim.y + threadIdx.y) + y_offset;
+
+    // check bounds
+    if (x >= width || y >= height) { return; }
+
+    const int index = y * width + x;
+
+    // `interior` holds the observers that never need a bounds check, as
+    // (x_begin, x_end, y_begin, y_end)
+    const bool inside = x >= interior.x && x < interior.y && y >= interior.z && y < interior.w;
+
+    const unsigned int visible_count = inside
+        ? count_visible<false>(height_map, x, y, width, height, num_rays, ray_offsets, offsets_x, offsets_y, inv_dist)
+        : count_visible<true>(height_map, x, y, width, height, num_rays, ray_offsets, offsets_x, offsets_y, inv_dist);
+
     // Store the visibility count
     const int visibility_map_index = index - (y_offset * width);
     visibility_map[visibility_map_index] = visible_count;
@@ -103,42 +113,42 @@ std::vector<unsigned int> calculate_visibility_cuda(
     // Allocate host result for this process
     std::vector<unsigned int> visibility_map(width * my_height, ~0);
 
-    // Number of discrete angles
-    const int num_angles = std::abs(angle);
-    // The distance between each angle in radians
-    const double angle_step = 2 * M_PI / num_angles;
+    // Precalculate the rays to be cast. The number of discrete angles is the
+    // absolute value of `angle`.
+    const RayStencil stencil(radius, std::abs(angle));
+    const int num_rays = static_cast<int>(stencil.num_rays());
 
-    // Allocate and initialize host ray directions
-    std::vector<float> ray_directions_x(num_angles);
-    std::vector<float> ray_directions_y(num_angles);
-
-    // Precalculate the angle of the rays to be cast
-    for (int i = 0; i < num_angles; ++i) {
-        const double angle_ = i * angle_step;
-        ray_directions_x[i] = static_cast<float>(std::cos(angle_) * radius);
-        ray_directions_y[i] = static_cast<float>(std::sin(angle_) * radius);
-    }
+    // Observers far enough from the edges of the map can skip the bounds checks
+    const auto interior = interior_region(stencil, width, height);
 
     // device memory
     int16_t *d_height_map = nullptr;
     unsigned int *d_visibility_map = nullptr;
-    float *d_ray_directions_x = nullptr;
-    float *d_ray_directions_y = nullptr;
+    unsigned int *d_ray_offsets = nullptr;
+    int *d_offsets_x = nullptr;
+    int *d_offsets_y = nullptr;
+    float *d_inv_dist = nullptr;
 
     // size calculations
     const size_t height_map_size = width * height * sizeof(int16_t);
     const size_t visibility_map_size = width * my_height * sizeof(unsigned int);
-    const size_t ray_directions_size = num_angles * sizeof(float);
+    const size_t ray_offsets_size = stencil.ray_offsets().size() * sizeof(unsigned int);
+    const size_t offsets_size = stencil.num_steps() * sizeof(int);
+    const size_t inv_dist_size = stencil.num_steps() * sizeof(float);
 
     cudaMalloc(&d_height_map, height_map_size);
     cudaMalloc(&d_visibility_map, visibility_map_size);
-    cudaMalloc(&d_ray_directions_x, ray_directions_size);
-    cudaMalloc(&d_ray_directions_y, ray_directions_size);
+    cudaMalloc(&d_ray_offsets, ray_offsets_size);
+    cudaMalloc(&d_offsets_x, offsets_size);
+    cudaMalloc(&d_offsets_y, offsets_size);
+    cudaMalloc(&d_inv_dist, inv_dist_size);
 
     // Copy data to device
     cudaMemcpy(d_height_map, height_map.data(), height_map_size, cudaMemcpyHostToDevice);
-    cudaMemcpy(d_ray_directions_x, ray_directions_x.data(), ray_directions_size, cudaMemcpyHostToDevice);
-    cudaMemcpy(d_ray_directions_y, ray_directions_y.data(), ray_directions_size, cudaMemcpyHostToDevice);
+    cudaMemcpy(d_ray_offsets, stencil.ray_offsets().data(), ray_offsets_size, cudaMemcpyHostToDevice);
+    cudaMemcpy(d_offsets_x, stencil.dx().data(), offsets_size, cudaMemcpyHostToDevice);
+    cudaMemcpy(d_offsets_y, stencil.dy().data(), offsets_size, cudaMemcpyHostToDevice);
+    cudaMemcpy(d_inv_dist, stencil.inv_dist().data(), inv_dist_size, cudaMemcpyHostToDevice);
 
     // Set up grid and block dimensions
     dim3 block_size(16, 16);
@@ -151,9 +161,12 @@ std::vector<unsigned int> calculate_visibility_cuda(
 
     calculate_visibility_kernel<<<grid_size, block_size>>>(
         d_height_map, d_visibility_map, 
-        width, height, radius, num_angles, my_y_offset, 
+        width, height, num_rays, my_y_offset, 
         my_rank,
-        d_ray_directions_x, d_ray_directions_y
+        d_ray_offsets, d_offsets_x, d_offsets_y, d_inv_dist,
+        make_int4(
+            static_cast<int>(interior.x_begin), static_cast<int>(interior.x_end),
+            static_cast<int>(interior.y_begin), static_cast<int>(interior.y_end))
     );
 
     // check for errors
@@ -171,8 +184,10 @@ std::vector<unsigned int> calculate_visibility_cuda(
     // Free device memory
     cudaFree(d_height_map);
     cudaFree(d_visibility_map);
-    cudaFree(d_ray_directions_x);
-    cudaFree(d_ray_directions_y);
+    cudaFree(d_ray_offsets);
+    cudaFree(d_offsets_x);
+    cudaFree(d_offsets_y);
+    cudaFree(d_inv_dist);
 
     // print a sum of the visibility_map for debugging
     unsigned int sum = 0;
@@ -9,12 +9,13 @@ __global__ void calculate_visibility_kernel(
     unsigned int *visibility_map,
     int width,
     int height,
-    int radius,
-    int num_angles,
+    int num_rays,
     int y_offset,
     int rank,
-    float *ray_directions_x,
-    float *ray_directions_y
+    const unsigned int *ray_offsets,
+    const int *offsets_x,
+    const int *offsets_y,
+    const float *inv_dist
 );
 
 std::vector<unsigned int> calculate_visibility_cuda(
@@ -0,0 +1,272 @@
+#include "approx_lines.hpp"
+#include "digital_lines.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AWANNACU_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+    /// The number of neighbouring observers of a line that are scanned together
+    constexpr size_t ObserverBlock = 16;
+
+    // Every block function counts how many of the next `num_samples` samples
+    // of `band` are visible from each of the `ObserverBlock` observers
+    // starting at `band[0]`. Sample `k` of observer `l` is `band[l + k]`, so
+    // one sample of the whole block is a single unit-stride load.
+
+    auto block_scalar(const float* band, const float* inv_dist, const size_t num_samples, unsigned int* counts) -> void
+    {
+        for (size_t l = 0; l < ObserverBlock; ++l) {
+            const float current_height = band[l];
+            float max_angle_seen = -std::numeric_limits<float>::infinity();
+            unsigned int visible = 0;
+
+            for (size_t k = 1; k <= num_samples; ++k) {
+                const float angle = (band[l + k] - current_height) * inv_dist[k];
+                if (angle > max_angle_seen) {
+                    max_angle_seen = angle;
+                    ++visible;
+                }
+            }
+
+            counts[l] = visible;
+        }
+    }
+
+#ifdef AWANNACU_X86
+
+    __attribute__((target("avx2")))
+    auto block_avx2(const float* band, const float* inv_dist, const size_t num_samples, unsigned int* counts) -> void
+    {
+        // Two registers of eight observers each
+        const __m256 h0_low = _mm256_loadu_ps(band);
+        const __m256 h0_high = _mm256_loadu_ps(band + 8);
+        __m256 max_low = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+        __m256 max_high = max_low;
+        __m256i visible_low = _mm256_setzero_si256();
+        __m256i visible_high = _mm256_setzero_si256();
+
+        for (size_t k = 1; k <= num_samples; ++k) {
+            const __m256 sample_inv_dist = _mm256_set1_ps(inv_dist[k]);
+            const __m256 angle_low = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(band + k), h0_low), sample_inv_dist);
+            const __m256 angle_high = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(band + k + 8), h0_high), sample_inv_dist);
+
+            visible_low = _mm256_sub_epi32(visible_low, _mm256_castps_si256(_mm256_cmp_ps(angle_low, max_low, _CMP_GT_OQ)));
+            visible_high = _mm256_sub_epi32(visible_high, _mm256_castps_si256(_mm256_cmp_ps(angle_high, max_high, _CMP_GT_OQ)));
+            max_low = _mm256_max_ps(angle_low, max_low);
+            max_high = _mm256_max_ps(angle_high, max_high);
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(counts), visible_low);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(counts + 8), visible_high);
+    }
+
+    // GCC's plain AVX-512 max starts from an undefined vector and then warns
+    // that it's uninitialized, the zero masking one doesn't
+    constexpr __mmask16 AllLanes = 0xFFFF;
+
+    __attribute__((target("avx512f")))
+    auto block_avx512(const float* band, const float* inv_dist, const size_t num_samples, unsigned int* counts) -> void
+    {
+        const __m512 h0 = _mm512_loadu_ps(band);
+        const __m512i one = _mm512_set1_epi32(1);
+        __m512 max_angle_seen = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+        __m512i visible = _mm512_setzero_si512();
+
+        for (size_t k = 1; k <= num_samples; ++k) {
+            const __m512 angle = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(band + k), h0), _mm512_set1_ps(inv_dist[k]));
+            const __mmask16 higher = _mm512_cmp_ps_mask(angle, max_angle_seen, _CMP_GT_OQ);
+
+            max_angle_seen = _mm512_maskz_max_ps(AllLanes, angle, max_angle_seen);
+            visible = _mm512_mask_add_epi32(visible, higher, visible, one);
+        }
+
+        _mm512_storeu_si512(counts, visible);
+    }
+
+#endif
+
+    using BlockFunction = auto (*)(const float*, const float*, size_t, unsigned int*) -> void;
+
+    auto block_function(const Isa isa) -> BlockFunction
+    {
+        switch (isa) {
+#ifdef AWANNACU_X86
+            case Isa::avx2: return block_avx2;
+            case Isa::avx512: return block_avx512;
+#endif
+            default: return block_scalar;
+        }
+    }
+
+    /// @returns `1 / (k * step)` for every sample `k` of `lines` within
+    ///          `radius`, with an unused entry for `k = 0`
+    auto sample_inv_dist(const DigitalLines& lines, const int radius) -> std::vector<float>
+    {
+        const double step = lines.step();
+        const auto num_samples = static_cast<size_t>(std::floor(std::max(radius, 0) / step));
+
+        std::vector<float> inv_dist(num_samples + 1, 0.0f);
+        for (size_t k = 1; k <= num_samples; ++k) {
+            inv_dist[k] = static_cast<float>(1.0 / (static_cast<double>(k) * step));
+        }
+        return inv_dist;
+    }
+
+    /// The number of rows and columns of the map that are sheared at once
+    constexpr size_t ShearTile = 64;
+
+    /// @returns the number of positions in one row of a sheared buffer. Past
+    ///          the end of every line there is room for the samples of its
+    ///          last observers, which never reach `radius` positions further.
+    auto sheared_stride(const DigitalLines& lines, const int radius) -> size_t
+    {
+        return lines.max_line_length() + ObserverBlock + static_cast<size_t>(std::max(radius, 0));
+    }
+}
+
+auto approx_line_visibility(
+    const Isa isa,
+    const tcb::span<const int16_t> height_map,
+    const size_t width,
+    const size_t height,
+    const int radius,
+    const int num_angles,
+    unsigned int* output) -> void
+{
+    constexpr double pi = 3.14159265358979323846;
+    constexpr float hidden = -std::numeric_limits<float>::infinity();
+    const auto count_block = block_function(isa_supported(isa) ? isa : Isa::scalar);
+
+    for (int ray = 0; ray < num_angles; ++ray) {
+        const DigitalLines lines(width, height, 2 * pi * ray / num_angles);
+
+        // Sample `k` of every observer is `k * step` away
+        const auto inv_dist = sample_inv_dist(lines, radius);
+        const size_t num_samples = inv_dist.size() - 1;
+
+        // Every pixel is on exactly one line, so the lines can be processed
+        // in parallel without any two threads touching the same pixel
+#pragma omp parallel
+        {
+            // Past the end of the line the band is padded with heights that
+            // can never be visible, so every observer scans all of its samples
+            std::vector<float> band(lines.max_line_length() + ObserverBlock + num_samples, hidden);
+            std::vector<unsigned int> counts(lines.max_line_length() + ObserverBlock);
+            size_t loaded = 0;
+
+#pragma omp for schedule(dynamic, 16)
+            for (size_t line = 0; line < lines.num_lines(); ++line) {
+                const size_t length = lines.line_length(line);
+
+                // Load the line once, in the direction of the ray
+                for (size_t i = 0; i < length; ++i) {
+                    band[i] = static_cast<float>(static_cast<uint16_t>(height_map[lines.cell(line, i)]));
+                }
+                if (loaded > length) {
+                    std::fill(band.begin() + static_cast<ptrdiff_t>(length), band.begin() + static_cast<ptrdiff_t>(loaded), hidden);
+                }
+                loaded = length;
+
+                for (size_t i = 0; i < length; i += ObserverBlock) {
+                    count_block(&band[i], inv_dist.data(), num_samples, &counts[i]);
+                }
+
+                for (size_t i = 0; i < length; ++i) {
+                    output[lines.cell(line, i)] += counts[i];
+                }
+            }
+        }
+    }
+}
+
+auto rotated_raster_visibility(
+    const Isa isa,
+    const tcb::span<const int16_t> height_map,
+    const size_t width,
+    const size_t height,
+    const int radius,
+    const int num_angles,
+    unsigned int* output) -> void
+{
+    constexpr double pi = 3.14159265358979323846;
+    constexpr float hidden = -std::numeric_limits<float>::infinity();
+    const auto count_block = block_function(isa_supported(isa) ? isa : Isa::scalar);
+
+    // Reused by every direction, it only grows to the largest one. It holds
+    // the heights of a direction and then its counts.
+    static_assert(sizeof(float) == sizeof(unsigned int));
+    std::vector<float> sheared;
+
+    for (int ray = 0; ray < num_angles; ++ray) {
+        const DigitalLines lines(width, height, 2 * pi * ray / num_angles);
+        const auto inv_dist = sample_inv_dist(lines, radius);
+        const size_t num_samples = inv_dist.size() - 1;
+        const size_t stride = sheared_stride(lines, radius);
+
+        // Positions that aren't on the map can never be visible
+        sheared.assign(lines.num_lines() * stride, hidden);
+
+        // Shear the map into the direction one tile at a time, so that both
+        // the map and the rows of the buffer are read and written in short
+        // sequential runs
+#pragma omp parallel for collapse(2) schedule(static)
+        for (size_t tile_y = 0; tile_y < height; tile_y += ShearTile) {
+            for (size_t tile_x = 0; tile_x < width; tile_x += ShearTile) {
+                for (size_t y = tile_y; y < std::min(tile_y + ShearTile, height); ++y) {
+                    for (size_t x = tile_x; x < std::min(tile_x + ShearTile, width); ++x) {
+                        sheared[lines.line_of(x, y) * stride + lines.position_of(x, y)] =
+                            static_cast<float>(static_cast<uint16_t>(height_map[y * width + x]));
+                    }
+                }
+            }
+        }
+
+        // Every row of the buffer is one line, scanned in place. A block only
+        // reads the heights from its own observers onwards, so its counts
+        // replace its heights and the buffer needs no second copy.
+#pragma omp parallel for schedule(dynamic, 16)
+        for (size_t line = 0; line < lines.num_lines(); ++line) {
+            const size_t begin = line * stride + lines.first_position(line);
+            const size_t end = begin + lines.line_length(line);
+
+            unsigned int block_counts[ObserverBlock];
+            for (size_t i = begin; i < end; i += ObserverBlock) {
+                count_block(&sheared[i], inv_dist.data(), num_samples, block_counts);
+                std::memcpy(&sheared[i], block_counts, sizeof(block_counts));
+            }
+        }
+
+        // And shear the counts back onto the map
+#pragma omp parallel for collapse(2) schedule(static)
+        for (size_t tile_y = 0; tile_y < height; tile_y += ShearTile) {
+            for (size_t tile_x = 0; tile_x < width; tile_x += ShearTile) {
+                for (size_t y = tile_y; y < std::min(tile_y + ShearTile, height); ++y) {
+                    for (size_t x = tile_x; x < std::min(tile_x + ShearTile, width); ++x) {
+                        unsigned int count;
+                        std::memcpy(&count, &sheared[lines.line_of(x, y) * stride + lines.position_of(x, y)], sizeof(count));
+                        output[y * width + x] += count;
+                    }
+                }
+            }
+        }
+    }
+}
+
+auto rotated_raster_bytes(const size_t width, const size_t height, const int radius, const int num_angles) -> size_t
+{
+    constexpr double pi = 3.14159265358979323846;
+
+    size_t largest = 0;
+    for (int ray = 0; ray < num_angles; ++ray) {
+        const DigitalLines lines(width, height, 2 * pi * ray / num_angles);
+        largest = std::max(largest, lines.num_lines() * sheared_stride(lines, radius));
+    }
+
+    return largest * sizeof(float);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "core.hpp"
+#include "simd.hpp"
+#include <cstdint>
+#include <vector>
+
+/// Adds the visible count of every pixel along each of `num_angles` evenly
+/// spaced directions to `output`, one direction at a time.
+///
+/// For one direction the map is cut into its digital lines (`DigitalLines`).
+/// Every observer on a line looks at the same height sequence, only shifted
+/// by its position, so each line is loaded into a contiguous buffer once and
+/// shared by all of its observers. Sample `k` ahead of an observer is always
+/// `k * step` away, which makes the inverse distances the same for every
+/// observer too, and a block of neighbouring observers is scanned together
+/// with unit-stride vector loads.
+///
+/// This is an approximation. The rays are the lines of the direction instead
+/// of the walked rays of a `RayStencil`, and they sample different cells, so
+/// the counts differ from the ones of `single_pixel_visiblity` (by about a
+/// quarter per pixel on real terrain). Every observer still scans its own
+/// `radius / step` samples, it only shares the loads. The observer itself is
+/// not counted.
+/// @param isa the instruction set of the scan, scalar if it isn't supported
+/// @param height_map the heights, `y * width + x`
+/// @param radius the distance (in pixels) that every observer can see
+/// @param num_angles the number of directions, the first one is +x
+/// @param output the `width * height` counts to add to
+auto approx_line_visibility(
+    const Isa isa,
+    const tcb::span<const int16_t> height_map,
+    const size_t width,
+    const size_t height,
+    const int radius,
+    const int num_angles,
+    unsigned int* output) -> void;
+
+/// Like `approx_line_visibility`, but for every direction the whole map
+/// is first sheared into a buffer with one row per line
+/// (`DigitalLines::line_of` and `position_of`), with the rows padded by
+/// heights that are never visible. The scan then reads every line in place,
+/// overwriting the heights with the counts as it goes, and the counts are
+/// sheared back onto the map. Only the shearing touches the map, in tiles,
+/// so no step of the scan jumps across rows of the map. Gives exactly the
+/// same counts as `approx_line_visibility`.
+/// @param isa the instruction set of the scan, scalar if it isn't supported
+/// @param height_map the heights, `y * width + x`
+/// @param radius the distance (in pixels) that every observer can see
+/// @param num_angles the number of directions, the first one is +x
+/// @param output the `width * height` counts to add to
+auto rotated_raster_visibility(
+    const Isa isa,
+    const tcb::span<const int16_t> height_map,
+    const size_t width,
+    const size_t height,
+    const int radius,
+    const int num_angles,
+    unsigned int* output) -> void;
+
+/// @returns the number of bytes of the sheared buffer of
+///          `rotated_raster_visibility`, which is sized for the direction
+///          with the most lines
+[[nodiscard]]
+auto rotated_raster_bytes(const size_t width, const size_t height, const int radius, const int num_angles) -> size_t;
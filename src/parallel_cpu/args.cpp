@@ -0,0 +1,162 @@
+#include "args.hpp"
+#include <fmt/core.h>
+#include <charconv>
+#include <string>
+
+namespace {
+    /// Splits `--name=value` into its name and value. Flags (`--name`) have
+    /// an empty value.
+    auto split_option(const std::string_view arg) -> std::optional<std::pair<std::string_view, std::string_view>>
+    {
+        if (arg.substr(0, 2) != "--") { return std::nullopt; }
+
+        const auto equals = arg.find('=');
+        if (equals == std::string_view::npos) { return std::pair{arg.substr(2), std::string_view{}}; }
+
+        return std::pair{arg.substr(2, equals - 2), arg.substr(equals + 1)};
+    }
+
+    auto parse_engine(const std::string_view value) -> std::optional<Engine>
+    {
+        for (const auto engine : AllEngines) {
+            if (value == engine_name(engine)) { return engine; }
+        }
+        return std::nullopt;
+    }
+
+    auto parse_slope(const std::string_view value) -> std::optional<SlopeMode>
+    {
+        if (value == "float") { return SlopeMode::floating; }
+        if (value == "fixed") { return SlopeMode::fixed; }
+        return std::nullopt;
+    }
+
+    auto parse_backend(const std::string_view value) -> std::optional<Backend>
+    {
+        if (value == "openmp") { return Backend::openmp; }
+        if (value == "pool") { return Backend::pool; }
+        if (value == "lpt") { return Backend::lpt; }
+        return std::nullopt;
+    }
+
+    auto parse_isa(const std::string_view value) -> std::optional<Isa>
+    {
+        for (const auto isa : {Isa::scalar, Isa::avx2, Isa::avx512}) {
+            if (value == isa_name(isa)) { return isa; }
+        }
+        return std::nullopt;
+    }
+}
+
+auto engine_name(const Engine engine) -> std::string_view
+{
+    switch (engine) {
+        case Engine::rays_simd: return "rays-simd";
+        case Engine::observers_simd: return "observers-simd";
+        case Engine::specialized: return "specialized";
+        case Engine::pruned: return "pruned";
+        case Engine::approx_lines: return "approx-lines";
+        case Engine::rotated: return "rotated";
+        case Engine::incremental: return "incremental";
+        default: return "scalar";
+    }
+}
+
+auto parse_options(const tcb::span<char*> args) -> std::optional<Options>
+{
+    Options options;
+
+    for (const std::string_view arg : args) {
+        const auto option = split_option(arg);
+        if (!option) {
+            fmt::println("Invalid argument '{}', expected --<name>=<value> or --<flag>", arg);
+            return std::nullopt;
+        }
+
+        const auto [name, value] = *option;
+        if (name == "engine") {
+            const auto engine = parse_engine(value);
+            if (!engine) {
+                fmt::println("Unknown engine '{}'", value);
+                return std::nullopt;
+            }
+            options.engine = *engine;
+        } else if (name == "isa") {
+            const auto isa = parse_isa(value);
+            if (!isa) {
+                fmt::println("Unknown instruction set '{}'", value);
+                return std::nullopt;
+            }
+            if (!isa_supported(*isa)) {
+                fmt::println("Instruction set '{}' is not supported by this CPU", value);
+                return std::nullopt;
+            }
+            options.isa = *isa;
+        } else if (name == "radius") {
+            int radius = 0;
+            const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), radius);
+            if (error != std::errc{} || end != value.data() + value.size() || radius <= 0) {
+                fmt::println("Invalid radius '{}', expected a positive number of pixels", value);
+                return std::nullopt;
+            }
+            options.radius = radius;
+        } else if (name == "tile") {
+            size_t tile_size = 0;
+            const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), tile_size);
+            if (error != std::errc{} || end != value.data() + value.size() || tile_size == 0) {
+                fmt::println("Invalid tile size '{}', expected a positive number of pixels", value);
+                return std::nullopt;
+            }
+            options.tile_size = tile_size;
+        } else if (name == "backend") {
+            const auto backend = parse_backend(value);
+            if (!backend) {
+                fmt::println("Unknown backend '{}'", value);
+                return std::nullopt;
+            }
+            options.backend = *backend;
+        } else if (name == "tile-log" && !value.empty()) {
+            options.tile_log = std::string(value);
+        } else if (name == "slope") {
+            const auto slope = parse_slope(value);
+            if (!slope) {
+                fmt::println("Unknown slope mode '{}'", value);
+                return std::nullopt;
+            }
+            options.slope = *slope;
+        } else if (name == "bench" && value.empty()) {
+            options.bench = true;
+        } else if (name == "numa" && value.empty()) {
+            options.numa = true;
+        } else {
+            fmt::println("Unknown option '--{}'", name);
+            return std::nullopt;
+        }
+    }
+
+    // The other engines have their own kernels, which only compare floats
+    if (options.slope == SlopeMode::fixed && (options.engine != Engine::scalar || options.bench)) {
+        fmt::println("--slope=fixed is only implemented by the scalar engine (without --bench)");
+        return std::nullopt;
+    }
+
+    return options;
+}
+
+auto print_options_usage() -> void
+{
+    fmt::println("Options:");
+    fmt::println("  --engine=<scalar|rays-simd|observers-simd|specialized|pruned|approx-lines|rotated|incremental>");
+    fmt::println("                                how observers are evaluated (default: scalar)");
+    fmt::println("  --isa=<scalar|avx2|avx512>    instruction set of the SIMD engines (default: {})", isa_name(best_isa()));
+    fmt::println("  --radius=<pixels>             how far every observer can see (default: 100)");
+    fmt::println("  --tile=<pixels>               side of the square tiles of observers (default: fits the L2 cache)");
+    fmt::println("  --backend=<openmp|pool|lpt>   what runs the tiles, pool is a work stealing thread pool and lpt assigns");
+    fmt::println("                                them to the threads by their estimated cost (default: openmp)");
+    fmt::println("  --tile-log=<file>             write the estimated cost and time of every tile of lpt to a CSV file");
+    fmt::println("  --slope=<float|fixed>         compare angles as floats or exactly rounded integers, fixed only with");
+    fmt::println("                                the scalar engine (default: float)");
+    fmt::println("  --bench                       time every engine before the actual run");
+    fmt::println("  --numa                        pin the threads of the tiled engines, copy the heights to every NUMA node");
+    fmt::println("                                and place the output of every tile on the node of its thread");
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "parallel_cpu.hpp"
+#include <optional>
+#include <string_view>
+
+/// @brief Parses the optional `--name=value` arguments that follow the
+///        positional arguments of `par_cpu`
+/// @param args the optional arguments
+/// @return the parsed options, or nothing if an argument is invalid (the
+///         problem is printed)
+auto parse_options(const tcb::span<char*> args) -> std::optional<Options>;
+
+/// @brief Prints the optional arguments understood by `parse_options`
+auto print_options_usage() -> void;
+
+/// @returns the command line name of `engine`
+auto engine_name(const Engine engine) -> std::string_view;
@@ -0,0 +1,328 @@
+#include "incremental.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace {
+    /// Runs shorter than this are read straight from the map. Sliding their
+    /// window and keeping their maximum costs more than reading their few
+    /// heights again.
+    constexpr uint32_t MinSlidingLength = 4;
+}
+
+RowRuns::RowRuns(const RayStencil& stencil, const std::vector<size_t>& rays, const bool transposed)
+{
+    const auto& dx = transposed ? stencil.dy() : stencil.dx();
+    const auto& dy = transposed ? stencil.dx() : stencil.dy();
+
+    ray_offsets_.push_back(0);
+
+    for (const size_t ray : rays) {
+        for (size_t begin = stencil.ray_begin(ray); begin < stencil.ray_end(ray);) {
+            // The steps up to the next change of row
+            size_t end = begin + 1;
+            while (end < stencil.ray_end(ray) && dy[end] == dy[begin]) { ++end; }
+
+            const auto [min_dx, max_dx] = std::minmax_element(dx.begin() + static_cast<ptrdiff_t>(begin), dx.begin() + static_cast<ptrdiff_t>(end));
+            const auto [min_inv, max_inv] = std::minmax_element(
+                stencil.inv_dist().begin() + static_cast<ptrdiff_t>(begin), stencil.inv_dist().begin() + static_cast<ptrdiff_t>(end));
+            const auto length = static_cast<uint32_t>(*max_dx - *min_dx + 1);
+
+            runs_.push_back({dy[begin], *min_dx, length,
+                             static_cast<uint32_t>(step_offset_.size()), static_cast<uint32_t>(step_offset_.size() + end - begin),
+                             *min_inv, *max_inv, static_cast<uint32_t>(window_size_)});
+
+            for (size_t step = begin; step < end; ++step) {
+                step_offset_.push_back(static_cast<uint32_t>(dx[step] - *min_dx));
+                inv_dist_.push_back(stencil.inv_dist()[step]);
+            }
+
+            window_size_ += length;
+            begin = end;
+        }
+        ray_offsets_.push_back(static_cast<uint32_t>(runs_.size()));
+    }
+}
+
+auto split_runs(const RayStencil& stencil) -> RunSplit
+{
+    RunSplit split;
+
+    for (size_t ray = 0; ray < stencil.num_rays(); ++ray) {
+        size_t row_runs = 0;
+        size_t column_runs = 0;
+        for (size_t step = stencil.ray_begin(ray); step < stencil.ray_end(ray); ++step) {
+            const bool first = step == stencil.ray_begin(ray);
+            row_runs += (first || stencil.dy()[step] != stencil.dy()[step - 1]) ? 1u : 0u;
+            column_runs += (first || stencil.dx()[step] != stencil.dx()[step - 1]) ? 1u : 0u;
+        }
+
+        (row_runs <= column_runs ? split.row_rays : split.column_rays).push_back(ray);
+    }
+
+    return split;
+}
+
+namespace {
+    /// The sliding windows of every run of a `RowRuns`, one set per thread
+    class Windows {
+    public:
+        explicit Windows(const RowRuns& runs)
+            : runs_(&runs), heights_(2 * runs.window_size()), queue_columns_(runs.window_size()),
+              queue_heights_(runs.window_size()), state_(runs.runs().size())
+        {
+            for (size_t r = 0; r < runs.runs().size(); ++r) {
+                if (runs.runs()[r].length >= MinSlidingLength) { sliding_.push_back(static_cast<uint32_t>(r)); }
+            }
+        }
+
+        /// Counts the cells that the runs make visible from every observer
+        /// `[x_begin, x_end)` of row `y`, and adds them to `output`
+        auto slide(const int16_t* heights, const size_t width, const size_t y,
+                   const size_t x_begin, const size_t x_end, unsigned int* output) -> void
+        {
+            const auto& runs = runs_->runs();
+            if (x_begin >= x_end) { return; }
+
+            // Fill the windows of the first observer
+            for (const uint32_t r : sliding_) {
+                const auto& run = runs[r];
+                const int16_t* const row = heights + static_cast<size_t>(static_cast<int64_t>(y) + run.dy) * width;
+                const auto first = static_cast<int64_t>(x_begin) + run.min_dx;
+
+                state_[r] = {0, 0, 0};
+                loads_ += run.length;
+                for (uint32_t i = 0; i < run.length; ++i) {
+                    const auto height = static_cast<float>(static_cast<uint16_t>(row[first + i]));
+                    heights_[2 * run.window + i] = height;
+                    heights_[2 * run.window + run.length + i] = height;
+                    push(r, static_cast<int32_t>(first + i), height);
+                }
+            }
+
+            for (size_t x = x_begin; x < x_end; ++x) {
+                if (x != x_begin) { advance(heights, width, y, x); }
+                output[x] += count(heights, width, y, x);
+            }
+        }
+
+        /// @returns the number of heights read from the map so far
+        [[nodiscard]] auto loads() const noexcept -> uint64_t { return loads_; }
+
+    private:
+        struct RunState {
+            /// The slot of the window holding its leftmost column
+            uint32_t start;
+            /// The first entry and the number of entries of the queue
+            uint32_t head;
+            uint32_t size;
+        };
+
+        /// Slides every window one column to the right, to observer `x`
+        auto advance(const int16_t* heights, const size_t width, const size_t y, const size_t x) -> void
+        {
+            const auto& runs = runs_->runs();
+            loads_ += sliding_.size();
+
+            for (const uint32_t r : sliding_) {
+                const auto& run = runs[r];
+                auto& state = state_[r];
+                const auto first = static_cast<int64_t>(x) + run.min_dx;
+
+                // The leftmost column of the previous observer drops out
+                if (state.size != 0 && queue_columns_[run.window + state.head] < first) {
+                    state.head = state.head + 1 == run.length ? 0 : state.head + 1;
+                    --state.size;
+                }
+
+                // And its slot takes the new rightmost one. The window is
+                // stored twice in a row, so that reading it from any slot
+                // never wraps around.
+                const int64_t last = first + run.length - 1;
+                const auto height = static_cast<float>(static_cast<uint16_t>(
+                    heights[static_cast<size_t>(static_cast<int64_t>(y) + run.dy) * width + static_cast<size_t>(last)]));
+                heights_[2 * run.window + state.start] = height;
+                heights_[2 * run.window + run.length + state.start] = height;
+                state.start = state.start + 1 == run.length ? 0 : state.start + 1;
+                push(r, static_cast<int32_t>(last), height);
+            }
+        }
+
+        /// Adds a column to the back of a run's queue, dropping every lower
+        /// height in front of it. The queue only holds columns that are still
+        /// in the window, so it never has more than `length` entries.
+        auto push(const size_t r, const int32_t column, const float height) -> void
+        {
+            const auto& run = runs_->runs()[r];
+            auto& state = state_[r];
+
+            while (state.size != 0) {
+                uint32_t back = state.head + state.size - 1;
+                back = back >= run.length ? back - run.length : back;
+                if (queue_heights_[run.window + back] > height) { break; }
+                --state.size;
+            }
+
+            uint32_t slot = state.head + state.size;
+            slot = slot >= run.length ? slot - run.length : slot;
+            queue_columns_[run.window + slot] = column;
+            queue_heights_[run.window + slot] = height;
+            ++state.size;
+        }
+
+        /// @returns the number of cells visible along the runs from observer `(x, y)`
+        [[nodiscard]] auto count(const int16_t* heights, const size_t width, const size_t y, const size_t x) -> unsigned int
+        {
+            const auto& runs = runs_->runs();
+            const uint32_t* const step_offset = runs_->step_offset().data();
+            const float* const inv_dist = runs_->inv_dist().data();
+            const auto current_height = static_cast<float>(static_cast<uint16_t>(heights[y * width + x]));
+            ++loads_;
+
+            unsigned int visible_count = 0;
+
+            for (size_t ray = 0; ray < runs_->num_rays(); ++ray) {
+                float max_angle_seen = -std::numeric_limits<float>::infinity();
+
+                for (size_t r = runs_->ray_begin(ray); r < runs_->ray_end(ray); ++r) {
+                    const auto& run = runs[r];
+
+                    if (run.length < MinSlidingLength) {
+                        loads_ += run.end - run.begin;
+                        const int16_t* const row = heights + static_cast<size_t>(static_cast<int64_t>(y) + run.dy) * width
+                            + static_cast<size_t>(static_cast<int64_t>(x) + run.min_dx);
+                        for (uint32_t step = run.begin; step < run.end; ++step) {
+                            const float angle = (static_cast<float>(static_cast<uint16_t>(row[step_offset[step]])) - current_height) * inv_dist[step];
+                            if (angle > max_angle_seen) {
+                                max_angle_seen = angle;
+                                visible_count++;
+                            }
+                        }
+                        continue;
+                    }
+
+                    // The highest height of the run at its most favourable
+                    // distance bounds every angle in it
+                    const auto& state = state_[r];
+                    const float height_diff = queue_heights_[run.window + state.head] - current_height;
+                    const float bound = height_diff * (height_diff >= 0.0f ? run.max_inv_dist : run.min_inv_dist);
+                    if (bound <= max_angle_seen) { continue; }
+
+                    const float* const window = heights_.data() + 2 * run.window + state.start;
+                    for (uint32_t step = run.begin; step < run.end; ++step) {
+                        const float angle = (window[step_offset[step]] - current_height) * inv_dist[step];
+                        if (angle > max_angle_seen) {
+                            max_angle_seen = angle;
+                            visible_count++;
+                        }
+                    }
+                }
+            }
+
+            return visible_count;
+        }
+
+        const RowRuns* runs_;
+        /// The heights read from the map so far
+        uint64_t loads_ = 0;
+        /// The runs that slide, the others are read from the map
+        std::vector<uint32_t> sliding_;
+        /// The heights of every window, each one twice as a ring buffer
+        std::vector<float> heights_;
+        /// The monotonic queue of every window (decreasing heights), as ring buffers
+        std::vector<int32_t> queue_columns_;
+        std::vector<float> queue_heights_;
+        std::vector<RunState> state_;
+    };
+
+    /// The number of rows and columns that are transposed at once
+    constexpr size_t TransposeTile = 64;
+
+    /// Calls `visit(x, y)` for every cell of a `width` by `height` map, one tile at a time
+    template<typename Visit>
+    auto for_each_tiled(const size_t width, const size_t height, Visit&& visit) -> void
+    {
+#pragma omp parallel for collapse(2) schedule(static)
+        for (size_t tile_y = 0; tile_y < height; tile_y += TransposeTile) {
+            for (size_t tile_x = 0; tile_x < width; tile_x += TransposeTile) {
+                for (size_t y = tile_y; y < std::min(tile_y + TransposeTile, height); ++y) {
+                    for (size_t x = tile_x; x < std::min(tile_x + TransposeTile, width); ++x) {
+                        visit(x, y);
+                    }
+                }
+            }
+        }
+    }
+}
+
+auto incremental_visibility(
+    const tcb::span<const int16_t> height_map,
+    const size_t width,
+    const size_t height,
+    const RayStencil& stencil,
+    unsigned int* output,
+    HeightLoads* loads) -> void
+{
+    const auto split = split_runs(stencil);
+    const RowRuns row_runs(stencil, split.row_rays, false);
+    const RowRuns column_runs(stencil, split.column_rays, true);
+
+    // Only observers that can't cast a ray off the map slide
+    const auto interior = interior_region(stencil, width, height);
+    const uint64_t observers = interior.x_end > interior.x_begin && interior.y_end > interior.y_begin
+        ? (interior.x_end - interior.x_begin) * (interior.y_end - interior.y_begin) : 0;
+    uint64_t total_loads = 0;
+
+    // The rays closer to horizontal slide along the rows of the map, and the
+    // border gets every ray from the scalar kernel
+#pragma omp parallel
+    {
+        Windows windows(row_runs);
+
+#pragma omp for schedule(dynamic, 4)
+        for (size_t y = 0; y < height; ++y) {
+            unsigned int* const row_output = output + y * width;
+
+            if (!interior.contains_row(y)) {
+                row_visibility(y, 0, width, width, height, height_map, stencil, interior, row_output);
+                continue;
+            }
+
+            row_visibility(y, 0, interior.x_begin, width, height, height_map, stencil, interior, row_output);
+            row_visibility(y, interior.x_end, width, width, height, height_map, stencil, interior, row_output + interior.x_end);
+
+            // The observer sees itself
+            std::fill(row_output + interior.x_begin, row_output + interior.x_end, 1u);
+            windows.slide(height_map.data(), width, y, interior.x_begin, interior.x_end, row_output);
+        }
+
+#pragma omp atomic
+        total_loads += windows.loads();
+    }
+
+    if (loads != nullptr) { *loads = {total_loads, observers, observers * (stencil.num_steps() + 1)}; }
+    if (split.column_rays.empty()) { return; }
+
+    // The others slide down the columns, which are the rows of the transposed map
+    std::vector<int16_t> transposed(width * height);
+    for_each_tiled(width, height, [&](const size_t x, const size_t y) { transposed[x * height + y] = height_map[y * width + x]; });
+
+    std::vector<unsigned int> column_counts(width * height, 0);
+
+#pragma omp parallel
+    {
+        Windows windows(column_runs);
+
+#pragma omp for schedule(dynamic, 4)
+        for (size_t x = interior.x_begin; x < interior.x_end; ++x) {
+            windows.slide(transposed.data(), height, x, interior.y_begin, interior.y_end, column_counts.data() + x * height);
+        }
+
+#pragma omp atomic
+        total_loads += windows.loads();
+    }
+
+    // Transposing the map reads all of it once more
+    if (loads != nullptr) { loads->loads = total_loads + width * height; }
+
+    for_each_tiled(width, height, [&](const size_t x, const size_t y) { output[y * width + x] += column_counts[x * height + y]; });
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "core.hpp"
+#include <cstdint>
+#include <vector>
+
+/// The rays of a `RayStencil` cut into runs of consecutive steps that stay on
+/// one row of the map.
+///
+/// Moving an observer one pixel along its row moves every run one pixel
+/// along its own row, so the next observer only needs the one new height at
+/// the end of every run. `incremental_visibility` keeps the heights of every
+/// run in a window that slides along with the observer.
+class RowRuns {
+public:
+    struct Run {
+        /// The row of the run, relative to the observer
+        int32_t dy;
+        /// The leftmost column of the run, relative to the observer. The run
+        /// covers `length` columns from there on.
+        int32_t min_dx;
+        uint32_t length;
+        /// The steps `[begin, end)` of `step_offset()` and `inv_dist()`
+        uint32_t begin;
+        uint32_t end;
+        /// The smallest and largest `inv_dist` of the steps
+        float min_inv_dist;
+        float max_inv_dist;
+        /// Where the run's window starts in a buffer of `window_size()` heights
+        uint32_t window;
+    };
+
+    /// @param rays the rays of `stencil` to cut up
+    /// @param transposed swap x and y, so the runs are along the columns of the
+    ///        map and the offsets are those of the transposed map
+    RowRuns(const RayStencil& stencil, const std::vector<size_t>& rays, const bool transposed);
+
+    /// @returns the number of rays
+    [[nodiscard]] auto num_rays() const noexcept -> size_t { return ray_offsets_.size() - 1; }
+
+    /// @returns the index of the first run of `ray`
+    [[nodiscard]] auto ray_begin(const size_t ray) const noexcept -> size_t { return ray_offsets_[ray]; }
+
+    /// @returns one past the index of the last run of `ray`
+    [[nodiscard]] auto ray_end(const size_t ray) const noexcept -> size_t { return ray_offsets_[ray + 1]; }
+
+    /// @returns every run of every ray, in the order the rays take them
+    [[nodiscard]] auto runs() const noexcept -> const std::vector<Run>& { return runs_; }
+
+    /// @returns the column of every step relative to the `min_dx` of its run
+    [[nodiscard]] auto step_offset() const noexcept -> const std::vector<uint32_t>& { return step_offset_; }
+
+    /// @returns `1 / distance` of every step
+    [[nodiscard]] auto inv_dist() const noexcept -> const std::vector<float>& { return inv_dist_; }
+
+    /// @returns the total length of all runs
+    [[nodiscard]] auto window_size() const noexcept -> size_t { return window_size_; }
+
+private:
+    std::vector<Run> runs_;
+    std::vector<uint32_t> ray_offsets_;
+    std::vector<uint32_t> step_offset_;
+    std::vector<float> inv_dist_;
+    size_t window_size_{0};
+};
+
+/// The rays of a stencil split by which way they are cut into fewer runs
+struct RunSplit {
+    /// Rays that stay on a row for longer than on a column (closer to horizontal)
+    std::vector<size_t> row_rays;
+    /// The other ones, cut along the columns of the map
+    std::vector<size_t> column_rays;
+};
+
+/// @returns the rays of `stencil` split by the direction they have fewer runs in
+[[nodiscard]]
+auto split_runs(const RayStencil& stencil) -> RunSplit;
+
+/// The heights that `incremental_visibility` actually read for its interior
+/// observers, counted as it ran
+struct HeightLoads {
+    /// Every height read from the map or its transposed copy: filling and
+    /// sliding the windows, the short runs, the observers' own heights and
+    /// copying the map into the transposed one
+    uint64_t loads = 0;
+    /// The number of interior observers
+    uint64_t observers = 0;
+    /// What the scalar kernel reads for the same observers, one height per
+    /// step of the stencil plus their own (their rays never stop early)
+    uint64_t scalar_loads = 0;
+};
+
+/// Calculates the same counts as `single_pixel_visiblity` for every pixel,
+/// reusing the work of the previous observer on the same row.
+///
+/// Every row of interior observers is walked from left to right, with the
+/// rays cut into `RowRuns`. The heights of each run sit in a ring buffer
+/// that slides along with the observer, and a monotonic queue next to it
+/// keeps the highest of them, so moving to the next observer reads one new
+/// height per run and updates the maximum in amortized constant time. A run
+/// whose maximum can't rise above the horizon so far is skipped without
+/// looking at its heights. Runs of only a few cells are cheaper to read from
+/// the map again, so they don't slide. The rays that are closer to vertical
+/// are handled the same way on a transposed copy of the map, walking down
+/// the columns. Observers near the edges use `row_visibility`.
+/// @param height_map the heights, `y * width + x`
+/// @param stencil the rays to cast
+/// @param output the `width * height` counts
+/// @param loads set to the heights read for the interior observers, if given
+auto incremental_visibility(
+    const tcb::span<const int16_t> height_map,
+    const size_t width,
+    const size_t height,
+    const RayStencil& stencil,
+    unsigned int* output,
+    HeightLoads* loads = nullptr) -> void;
@@ -15,25 +15,40 @@
 #include <iterator> // For std::istreambuf_iterator
 #include <cstdlib> // For std::abs
 #include <cstring> // For std::memcpy
+#include <optional>
 
 #include "parallel_cpu.hpp"
+#include "args.hpp"
+#include "approx_lines.hpp"
+#include "static_visibility.hpp"
 
 #ifdef _OPENMP 
     #include <omp.h>
 #endif
 
 int main(int argc, char** argv) {
-    // Usage: ./<exec> <read_file> <write_file> <width> <height>
-    if (argc != 7) {
-        std::cerr << "Usage: " << argv[0] << " <read_file> <write_file> <width> <height> <angle> <threads>" << std::endl;
+    // Usage: ./<exec> <read_file> <write_file> <width> <height> <angle> <threads> [options]
+    if (argc < 7) {
+        std::cerr << "Usage: " << argv[0] << " <read_file> <write_file> <width> <height> <angle> <threads> [options]" << std::endl;
+        std::cerr << "  <threads> of 0 uses every core" << std::endl;
+        print_options_usage();
         return 1;
     }
+
+    // Parse the optional arguments
+    auto options = parse_options(tcb::span(argv + 7, static_cast<size_t>(argc - 7)));
+    if (!options) {
+        print_options_usage();
+        return 1;
+    }
+    options->threads = std::stoul(argv[6]);
     
-#ifdef _OMP
-    // set the number of threads to use
-    const auto num_threads = std::stoi(argv[6]);
-    omp_set_num_threads(num_threads);
-    fmt::println("Set number of threads to {}", num_threads);
+#ifdef _OPENMP
+    // set the number of threads to use, 0 for every core like the pool (OpenMP
+    // itself would run 0 threads as 1)
+    if (options->threads == 0) { options->threads = static_cast<size_t>(omp_get_num_procs()); }
+    omp_set_num_threads(static_cast<int>(options->threads));
+    fmt::println("Set number of threads to {}", options->threads);
 #endif
 
     // Parse width and height from command line
@@ -42,19 +57,79 @@ int main(int argc, char** argv) {
 	const int angle = std::stoi(argv[5]);
     
     // Allocate memory for height map
-    std::vector<int16_t> height_map = read_input(argv[1]);
+    huge_vector<int16_t> height_map = read_input<huge_page_allocator<int16_t>>(argv[1]);
     std::cout << "Height map loaded: " << width << "x" << height << std::endl;
     
+    // The radius (in pixels) that every observer can see
+    const int radius = options->radius;
+
+    // The pruned engine needs the block maxima of the map, which are built
+    // once up front and timed on their own
+    std::optional<HeightPyramid> pyramid;
+    if (options->engine == Engine::pruned || options->bench) {
+        timer build_time;
+        pyramid.emplace(height_map, width, height);
+        fmt::println("Height pyramid built in {} ms ({} levels)", build_time.read(), pyramid->num_levels());
+    }
+    const HeightPyramid* const pyramid_ptr = pyramid ? &*pyramid : nullptr;
+
+    // The rotated engine keeps a sheared copy of the map
+    if (options->engine == Engine::rotated || options->bench) {
+        const auto bytes = rotated_raster_bytes(width, height, radius, std::abs(angle));
+        const auto map_bytes = std::max<size_t>(height_map.size() * sizeof(int16_t), 1);
+        fmt::println("Rotated raster buffer: {:.1f} MiB ({:.2f}x the height map)",
+            static_cast<double>(bytes) / (1024.0 * 1024.0), static_cast<double>(bytes) / static_cast<double>(map_bytes));
+    }
+
+    // The scalar, specialized and pruned engines work through tiles of observers
+    if (options->engine == Engine::scalar || options->engine == Engine::specialized || options->engine == Engine::pruned || options->bench) {
+        const auto tile_size = observer_tile_size(*options);
+        fmt::println("Observer tiles: {}x{} ({} KiB of level 2 cache)", tile_size, tile_size, l2_cache_bytes() / 1024);
+
+        // Where the threads, the heights and the output go
+        if (options->numa) {
+            const auto placement = numa_placement(*options);
+            fmt::println("NUMA: {} thread(s) on {} node(s), height map {}",
+                placement.thread_cpu.size(), placement.num_nodes,
+                placement.num_nodes > 1 ? "copied to every node" : "shared");
+            for (size_t node = 0; node < placement.num_nodes; ++node) {
+                std::vector<size_t> cpus;
+                for (size_t thread = 0; thread < placement.thread_cpu.size(); ++thread) {
+                    if (placement.thread_node[thread] == node) { cpus.push_back(placement.thread_cpu[thread]); }
+                }
+                fmt::println("  node {}: {} thread(s) pinned to CPUs {}", node, cpus.size(), format_cpu_list(cpus));
+            }
+        }
+    }
+
+    // Compare every engine on this input first if asked to
+    if (options->bench) {
+        benchmarkEngines(height_map, width, height, radius, angle, *options, pyramid_ptr);
+    }
+
+    fmt::println("Engine: {} ({})", engine_name(options->engine), isa_name(options->isa));
+    if (options->engine == Engine::specialized && find_visibility_kernel(radius, std::abs(angle)) == nullptr) {
+        fmt::println("No kernel is compiled for radius {} and {} angles, using the generic one", radius, std::abs(angle));
+    }
+
     // time the algorithm
     timer time;
     time.reset();
 
     // Calculate visibility map
-    int radius = 100;
-    std::vector<uint32_t> visibility_map = calculateVisibility(height_map, width, height, radius, angle);
+    RunStats run_stats;
+    huge_vector<uint32_t> visibility_map = calculateVisibility(height_map, width, height, radius, angle, *options, pyramid_ptr, &run_stats);
 
     // display the elapsed time
     fmt::println("Elapsed time: {} ms", time.read());
+
+    // Whether the kernel found huge pages for the big arrays
+    fmt::println("Huge pages: height map {}, output {}",
+        describe_huge_pages(huge_page_usage(height_map.data(), height_map.size() * sizeof(int16_t))),
+        describe_huge_pages(huge_page_usage(visibility_map.data(), visibility_map.size() * sizeof(uint32_t))));
+
+    // Show how evenly the tiles were spread over the threads
+    reportRunStats(run_stats, options->tile_log);
     
     // Write the output
     write_output<uint32_t>(argv[2], visibility_map);
@@ -1,45 +1,494 @@
 #include "parallel_cpu.hpp"
+#include "args.hpp"
+#include "approx_lines.hpp"
+#include "incremental.hpp"
+#include "static_visibility.hpp"
 #include <fmt/core.h>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <optional>
 
 #ifdef _OPENMP 
 #include <omp.h>
 #endif
 
-auto calculateVisibility(const std::vector<int16_t>& height_map, 
+namespace {
+    /// The number of steps of a ray that `Engine::pruned` bounds at once
+    constexpr size_t PruneSegmentLength = 16;
+
+    /// @returns the number of threads of the OpenMP loops
+    auto max_threads() -> size_t
+    {
+#ifdef _OPENMP
+        return static_cast<size_t>(std::max(omp_get_max_threads(), 1));
+#else
+        return 1;
+#endif
+    }
+
+    /// Lets the calling thread run on the CPUs it had when this was made
+    /// again, once it goes out of scope
+    struct RestoreAffinity {
+        std::vector<size_t> cpus = thread_cpus();
+
+        RestoreAffinity() = default;
+        RestoreAffinity(const RestoreAffinity&) = delete;
+        auto operator=(const RestoreAffinity&) -> RestoreAffinity& = delete;
+        ~RestoreAffinity() { unpin_thread(cpus); }
+    };
+
+    /// Frees a copy of the height map from `huge_page_allocate`
+    struct HugePageDeleter {
+        size_t bytes;
+        auto operator()(int16_t* data) const noexcept -> void { huge_page_free(data, bytes); }
+    };
+
+    /// The copy of the height map on one NUMA node
+    using NodeHeights = std::unique_ptr<int16_t[], HugePageDeleter>;
+
+    /// @returns the tiles of every one of `num_threads` threads, in
+    ///          contiguous blocks like `WorkStealingPool` deals them out
+    auto block_assignment(const size_t num_tiles, const size_t num_threads) -> std::vector<std::vector<size_t>>
+    {
+        std::vector<std::vector<size_t>> assignment(num_threads);
+        for (size_t thread = 0; thread < num_threads; ++thread) {
+            for (size_t i = thread * num_tiles / num_threads; i < (thread + 1) * num_tiles / num_threads; ++i) {
+                assignment[thread].push_back(i);
+            }
+        }
+        return assignment;
+    }
+
+    /// Runs the tiles on one thread per entry of `assignment` (from
+    /// `lpt_assignment` for `costs`), each of them with its tiles, and times
+    /// every tile
+    template<typename TileFunction>
+    auto run_lpt(
+        const std::vector<Tile>& tiles,
+        const std::vector<double>& costs,
+        const std::vector<std::vector<size_t>>& assignment,
+        RunStats* run_stats,
+        const TileFunction& run_tile) -> void
+    {
+        using clock = std::chrono::steady_clock;
+        const auto nanoseconds = [](const clock::duration duration) {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+        };
+
+        std::vector<uint64_t> tile_ns(tiles.size(), 0);
+
+        const auto begin = clock::now();
+#pragma omp parallel for schedule(static, 1) num_threads(static_cast<int>(assignment.size()))
+        for (size_t worker = 0; worker < assignment.size(); ++worker) {
+            for (const size_t i : assignment[worker]) {
+                const auto tile_begin = clock::now();
+                run_tile(i);
+                tile_ns[i] = nanoseconds(clock::now() - tile_begin);
+            }
+        }
+        const uint64_t elapsed = nanoseconds(clock::now() - begin);
+
+        if (run_stats == nullptr) { return; }
+
+        run_stats->workers.assign(assignment.size(), WorkerStats{});
+        run_stats->tiles.resize(tiles.size());
+        for (size_t worker = 0; worker < assignment.size(); ++worker) {
+            auto& stats = run_stats->workers[worker];
+            for (const size_t i : assignment[worker]) {
+                stats.busy_ns += tile_ns[i];
+                stats.tasks += 1;
+                run_stats->tiles[i] = TileTiming{tiles[i], worker, costs[i], tile_ns[i]};
+            }
+            stats.idle_ns = elapsed - std::min(elapsed, stats.busy_ns);
+        }
+    }
+
+    /// Pins the OpenMP threads to the CPUs of `placement`. Every thread then
+    /// writes the output of its tiles in `assignment`, the ones it is going
+    /// to run (or be dealt first), so those pages end up on its node, and the
+    /// threads of every node copy the height map into a copy of its own
+    /// (unless there is only one node).
+    /// @returns the height map of every node, none with only one node
+    auto place_on_nodes(
+        const NumaPlacement& placement,
+        const std::vector<std::vector<size_t>>& assignment,
+        const std::vector<Tile>& tiles,
+        const size_t width,
+        const tcb::span<const int16_t> height_map,
+        huge_vector<unsigned int>& output) -> std::vector<NodeHeights>
+    {
+        const size_t num_threads = placement.thread_cpu.size();
+
+        // The threads of every node are a contiguous block
+        std::vector<size_t> first_thread(placement.num_nodes, num_threads);
+        std::vector<size_t> node_threads(placement.num_nodes, 0);
+        for (size_t thread = 0; thread < num_threads; ++thread) {
+            const size_t node = placement.thread_node[thread];
+            first_thread[node] = std::min(first_thread[node], thread);
+            ++node_threads[node];
+        }
+
+        // On huge pages, and not touched yet, so every page goes wherever it
+        // is first written
+        std::vector<NodeHeights> node_heights;
+        if (placement.num_nodes > 1) {
+            const size_t bytes = height_map.size() * sizeof(int16_t);
+            for (size_t node = 0; node < placement.num_nodes; ++node) {
+                auto* data = static_cast<int16_t*>(huge_page_allocate(bytes));
+                if (data == nullptr) { throw std::bad_alloc(); }
+                node_heights.emplace_back(data, HugePageDeleter{bytes});
+            }
+        }
+        release_pages(output.data(), output.size() * sizeof(unsigned int));
+
+#pragma omp parallel num_threads(static_cast<int>(num_threads))
+        {
+#ifdef _OPENMP
+            const auto thread = static_cast<size_t>(omp_get_thread_num());
+#else
+            const size_t thread = 0;
+#endif
+            const size_t node = placement.thread_node[thread];
+            pin_thread(placement.thread_cpu[thread], node);
+
+            for (const size_t i : assignment[thread]) {
+                for (size_t y = tiles[i].y_begin; y < tiles[i].y_end; ++y) {
+                    std::fill_n(output.data() + y * width + tiles[i].x_begin, tiles[i].x_end - tiles[i].x_begin, 0u);
+                }
+            }
+
+            if (!node_heights.empty()) {
+                const size_t share = thread - first_thread[node];
+                const size_t begin = share * height_map.size() / node_threads[node];
+                const size_t end = (share + 1) * height_map.size() / node_threads[node];
+                std::copy(height_map.begin() + static_cast<ptrdiff_t>(begin), height_map.begin() + static_cast<ptrdiff_t>(end), &node_heights[node][begin]);
+            }
+        }
+
+        return node_heights;
+    }
+
+    /// Calls `row(y, x_begin, x_end)` for every row of every tile, on the
+    /// threads of `options.backend` (pinned to the CPUs of `placement`, if
+    /// there is one). Unless they are assigned up front (by their `costs`,
+    /// or to the pinned threads that placed their output), the tiles are
+    /// handed out one at a time in their (Morton) order, so the threads work
+    /// on tiles close to each other and every tile's heights stay in the
+    /// cache while its observers are processed.
+    template<typename RowFunction>
+    auto for_each_tile_row(
+        const std::vector<Tile>& tiles,
+        const std::vector<double>& costs,
+        const std::vector<std::vector<size_t>>& assignment,
+        const Options& options,
+        const NumaPlacement* placement,
+        RunStats* run_stats,
+        const RowFunction& row) -> void
+    {
+        const auto run_tile = [&](const size_t i) {
+            const Tile& tile = tiles[i];
+            for (size_t y = tile.y_begin; y < tile.y_end; ++y) {
+                row(y, tile.x_begin, tile.x_end);
+            }
+        };
+
+        if (options.backend == Backend::pool) {
+            const auto pin = [placement](const size_t worker) {
+                pin_thread(placement->thread_cpu[worker], placement->thread_node[worker]);
+            };
+            WorkStealingPool pool = placement != nullptr
+                ? WorkStealingPool(placement->thread_cpu.size(), pin)
+                : WorkStealingPool(options.threads);
+            pool.run(tiles.size(), run_tile);
+            if (run_stats != nullptr) { run_stats->workers = pool.stats(); }
+            return;
+        }
+
+        if (options.backend == Backend::lpt) {
+            run_lpt(tiles, costs, assignment, run_stats, run_tile);
+            return;
+        }
+
+        // The pinned threads run the tiles whose output is on their node
+        if (placement != nullptr && !assignment.empty()) {
+#pragma omp parallel for schedule(static, 1) num_threads(static_cast<int>(assignment.size()))
+            for (size_t thread = 0; thread < assignment.size(); ++thread) {
+                for (const size_t i : assignment[thread]) {
+                    run_tile(i);
+                }
+            }
+            return;
+        }
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < tiles.size(); ++i) {
+            run_tile(i);
+        }
+    }
+}
+
+auto numa_placement(const Options& options) -> NumaPlacement
+{
+    const size_t num_threads = options.backend == Backend::pool && options.threads != 0 ? options.threads : max_threads();
+    return place_threads(read_numa_topology(), num_threads);
+}
+
+auto observer_tile_size(const Options& options) -> size_t
+{
+    return options.tile_size != 0 ? options.tile_size : cache_tile_size(options.radius, l2_cache_bytes());
+}
+
+auto calculateVisibility(const tcb::span<const int16_t> height_map, 
                          size_t width, size_t height, 
-                         int radius, int angle) -> std::vector<unsigned int>
+                         int radius, int angle,
+                         const Options& options,
+                         const HeightPyramid* pyramid,
+                         RunStats* run_stats) -> huge_vector<unsigned int>
 {
-    std::vector<unsigned int> visibility_map(width * height, 0);
-    const int radius_squared = radius * radius;
-    
-    // Number of discrete angles
-    const int num_angles = std::abs(angle); 
-    // The distance between each angle in radians
-    const double angle_step = 2 * M_PI / num_angles;
-    
-    std::vector<std::pair<float, float>> ray_directions;
-    ray_directions.reserve(static_cast<uint64_t>(num_angles));
-    
-    // precalculate the angle of the rays to be cast
-    for (int i = 0; i < num_angles; ++i) {
-        const double angle_ = i * angle_step;
-        float dx = std::round(std::cos(angle_) * radius);
-        float dy = std::round(std::sin(angle_) * radius);
-        ray_directions.push_back({dx, dy});
+    huge_vector<unsigned int> visibility_map(width * height, 0);
+
+    // Precalculate the rays to be cast. The number of discrete angles is the
+    // absolute value of `angle`.
+    const RayStencil stencil(radius, std::abs(angle));
+
+    // Only the generic scalar kernel compares slopes in fixed point (the
+    // options don't allow it with any other engine)
+    const bool floating = options.slope == SlopeMode::floating;
+
+    // The SIMD engines need a supported instruction set, and the ray engine
+    // gathers two heights at a time so it needs at least two of them
+    const bool simd = floating && options.isa != Isa::scalar && isa_supported(options.isa) && height_map.size() >= 2;
+
+    // Observers far enough from the edges can skip the bounds checks
+    const auto interior = interior_region(stencil, width, height);
+
+    if (simd && options.engine == Engine::rays_simd) {
+        // Regroup the rays so a vector register's worth of them can be marched together
+        const LockstepStencil lockstep(stencil, isa_lanes(options.isa));
+
+#pragma omp parallel for
+        for (size_t y = 0; y < height; ++y) {
+            simd_rays_row(options.isa, y, width, height, height_map, stencil, lockstep, interior, &visibility_map[y * width]);
+        }
+
+        return visibility_map;
     }
-    
-    // Process each pixel
-    //use parallel cpu with opeMP
-#pragma omp parallel for collapse(2)
-    for (size_t y = 0; y < height; ++y) {
-        for (size_t x = 0; x < width; ++x) {
-            visibility_map[y * width + x] = single_pixel_visiblity(
-                x, y, width, height, radius, radius_squared, height_map, ray_directions
-            );
+
+    if (simd && options.engine == Engine::observers_simd) {
+#pragma omp parallel for
+        for (size_t y = 0; y < height; ++y) {
+            simd_observers_row(options.isa, y, width, height, height_map, stencil, interior, &visibility_map[y * width]);
+        }
+
+        return visibility_map;
+    }
+
+    // The remaining engines evaluate square tiles of observers
+    const auto tiles = morton_tiles(width, height, observer_tile_size(options));
+
+    // Estimate the work of every tile to share them out by
+    std::vector<double> costs(options.backend == Backend::lpt ? tiles.size() : 0);
+    if (options.backend == Backend::lpt) {
+#pragma omp parallel for schedule(dynamic, 1)
+        for (size_t i = 0; i < tiles.size(); ++i) {
+            costs[i] = estimate_tile_cost(tiles[i], width, height, height_map, stencil);
+        }
+    }
+
+    // The tiles of every thread, where they are decided up front: by their
+    // costs, or in contiguous blocks for the threads that `--numa` pins
+    std::vector<std::vector<size_t>> assignment;
+    if (options.backend == Backend::lpt) {
+        assignment = lpt_assignment(costs, max_threads());
+    }
+
+    // Put the threads, the heights and the output on the NUMA nodes. Every
+    // thread reads the heights of its own node, and first writes the output
+    // of the tiles it runs. The OpenMP threads stay pinned for the loops
+    // below, but the calling thread (OpenMP's first thread) gets its own
+    // CPUs back before this returns.
+    std::optional<NumaPlacement> placement;
+    std::vector<NodeHeights> node_heights;
+    std::optional<RestoreAffinity> restore_affinity;
+    if (options.numa) {
+        restore_affinity.emplace();
+        placement = numa_placement(options);
+        if (options.backend != Backend::lpt) {
+            assignment = block_assignment(tiles.size(), placement->thread_cpu.size());
+        }
+        node_heights = place_on_nodes(*placement, assignment, tiles, width, height_map, visibility_map);
+    }
+    const auto heights = [&]() -> tcb::span<const int16_t> {
+        if (node_heights.empty()) { return height_map; }
+        return {node_heights[current_numa_node()].get(), height_map.size()};
+    };
+    const NumaPlacement* const placement_ptr = placement ? &*placement : nullptr;
+
+    // Use the kernel compiled for this configuration if there is one
+    const auto kernel = floating && options.engine == Engine::specialized ? find_visibility_kernel(radius, std::abs(angle)) : nullptr;
+    if (kernel != nullptr) {
+        for_each_tile_row(tiles, costs, assignment, options, placement_ptr, run_stats, [&](const size_t y, const size_t x_begin, const size_t x_end) {
+            kernel(y, x_begin, x_end, width, height, heights(), &visibility_map[y * width + x_begin]);
+        });
+
+        return visibility_map;
+    }
+
+    // Share the lines of each direction between their observers. Every
+    // observer sees itself on top of what its rays see.
+    if (floating && (options.engine == Engine::approx_lines || options.engine == Engine::rotated)) {
+        if (options.engine == Engine::rotated) {
+            rotated_raster_visibility(options.isa, height_map, width, height, radius, std::abs(angle), visibility_map.data());
+        } else {
+            approx_line_visibility(options.isa, height_map, width, height, radius, std::abs(angle), visibility_map.data());
         }
+        std::for_each(visibility_map.begin(), visibility_map.end(), [](unsigned int& count) { ++count; });
+
+        return visibility_map;
+    }
+
+    // Reuse the previous observer's heights along every row
+    if (floating && options.engine == Engine::incremental) {
+        incremental_visibility(height_map, width, height, stencil, visibility_map.data(), run_stats != nullptr ? &run_stats->loads : nullptr);
+
+        return visibility_map;
     }
 
+    // Skip the stretches of rays that the pyramid proves hidden
+    if (floating && options.engine == Engine::pruned && pyramid != nullptr) {
+        const RaySegments segments(stencil, PruneSegmentLength);
+
+        for_each_tile_row(tiles, costs, assignment, options, placement_ptr, run_stats, [&](const size_t y, const size_t x_begin, const size_t x_end) {
+            pruned_row_visibility(y, x_begin, x_end, width, height, heights(), stencil, segments, *pyramid, interior, &visibility_map[y * width + x_begin]);
+        });
+
+        return visibility_map;
+    }
+    
+    // Process each tile
+    for_each_tile_row(tiles, costs, assignment, options, placement_ptr, run_stats, [&](const size_t y, const size_t x_begin, const size_t x_end) {
+        row_visibility(y, x_begin, x_end, width, height, heights(), stencil, interior, &visibility_map[y * width + x_begin], options.slope);
+    });
+
     return visibility_map;
-}
\ No newline at end of file
+}
+
+auto benchmarkEngines(const tcb::span<const int16_t> height_map,
+                      size_t width, size_t height,
+                      int radius, int angle,
+                      const Options& options,
+                      const HeightPyramid* pyramid) -> void
+{
+    fmt::println("Benchmarking engines ({} instructions):", isa_name(options.isa));
+
+    huge_vector<unsigned int> reference;
+    uint64_t reference_time = 0;
+
+    for (const auto engine : AllEngines) {
+        Options engine_options = options;
+        engine_options.engine = engine;
+
+        timer time;
+        const auto result = calculateVisibility(height_map, width, height, radius, angle, engine_options, pyramid);
+        const auto elapsed = std::max<uint64_t>(time.read(), 1);
+
+        // Everything is compared against the first (scalar) engine
+        if (reference.empty()) {
+            reference = result;
+            reference_time = elapsed;
+        }
+
+        // Engines with other rays are off by a little, so show by how much
+        size_t mismatches = 0;
+        uint64_t total_difference = 0;
+        for (size_t i = 0; i < result.size(); ++i) {
+            mismatches += result[i] != reference[i];
+            total_difference += result[i] > reference[i] ? result[i] - reference[i] : reference[i] - result[i];
+        }
+        const double mean_difference = result.empty() ? 0.0 : static_cast<double>(total_difference) / static_cast<double>(result.size());
+
+        fmt::println("  {:<16} {:>8} ms  {:>6.2f}x  {} mismatches (mean difference {:.2f})",
+            engine_name(engine), elapsed,
+            static_cast<double>(reference_time) / static_cast<double>(elapsed), mismatches, mean_difference);
+    }
+}
+
+auto reportRunStats(const RunStats& stats, const std::string& tile_log) -> void
+{
+    constexpr double ns_per_ms = 1e6;
+
+    // Counted while the incremental engine ran, against what the scalar
+    // kernel reads for the same observers
+    if (stats.loads.observers > 0) {
+        const auto observers = static_cast<double>(stats.loads.observers);
+        fmt::println("Height map loads per interior pixel: {:.1f} incremental, {:.1f} scalar",
+            static_cast<double>(stats.loads.loads) / observers, static_cast<double>(stats.loads.scalar_loads) / observers);
+    }
+
+    // The costs are in ray steps, so they are only compared after scaling
+    // them to the total time of the tiles
+    double total_cost = 0.0;
+    double total_ns = 0.0;
+    for (const auto& tile : stats.tiles) {
+        total_cost += tile.predicted_cost;
+        total_ns += static_cast<double>(tile.actual_ns);
+    }
+    const double ns_per_cost = total_cost > 0.0 ? total_ns / total_cost : 0.0;
+
+    std::vector<double> predicted_ns(stats.workers.size(), 0.0);
+    for (const auto& tile : stats.tiles) {
+        predicted_ns[tile.worker] += tile.predicted_cost * ns_per_cost;
+    }
+
+    for (size_t worker = 0; worker < stats.workers.size(); ++worker) {
+        const auto& worker_stats = stats.workers[worker];
+        if (stats.tiles.empty()) {
+            fmt::println("  Worker {:>3}: busy {:>8} ms, idle {:>8} ms, {} tiles ({} stolen)",
+                worker, worker_stats.busy_ns / 1000000, worker_stats.idle_ns / 1000000, worker_stats.tasks, worker_stats.stolen);
+        } else {
+            fmt::println("  Worker {:>3}: busy {:>8} ms (predicted {:>8.0f} ms), idle {:>8} ms, {} tiles",
+                worker, worker_stats.busy_ns / 1000000, predicted_ns[worker] / ns_per_ms, worker_stats.idle_ns / 1000000, worker_stats.tasks);
+        }
+    }
+
+    if (stats.tiles.empty()) { return; }
+
+    // How closely the scaled costs follow the actual times
+    const double mean = total_ns / static_cast<double>(stats.tiles.size());
+    double covariance = 0.0;
+    double predicted_variance = 0.0;
+    double actual_variance = 0.0;
+    double absolute_error = 0.0;
+    for (const auto& tile : stats.tiles) {
+        const double predicted = tile.predicted_cost * ns_per_cost - mean;
+        const double actual = static_cast<double>(tile.actual_ns) - mean;
+        covariance += predicted * actual;
+        predicted_variance += predicted * predicted;
+        actual_variance += actual * actual;
+        absolute_error += std::abs(predicted - actual);
+    }
+    const double correlation = predicted_variance > 0.0 && actual_variance > 0.0
+        ? covariance / std::sqrt(predicted_variance * actual_variance) : 0.0;
+
+    fmt::println("Tile cost model: correlation {:.3f}, mean error {:.1f}% of the mean tile time ({} tiles)",
+        correlation, total_ns > 0.0 ? 100.0 * absolute_error / total_ns : 0.0, stats.tiles.size());
+
+    if (tile_log.empty()) { return; }
+
+    std::ofstream log(tile_log);
+    if (!log) {
+        fmt::println("Could not write the tile log to {}", tile_log);
+        return;
+    }
+    log << "x_begin,x_end,y_begin,y_end,worker,predicted_cost,predicted_ms,actual_ms\n";
+    for (const auto& tile : stats.tiles) {
+        log << fmt::format("{},{},{},{},{},{:.0f},{:.3f},{:.3f}\n",
+            tile.tile.x_begin, tile.tile.x_end, tile.tile.y_begin, tile.tile.y_end, tile.worker,
+            tile.predicted_cost, tile.predicted_cost * ns_per_cost / ns_per_ms, static_cast<double>(tile.actual_ns) / ns_per_ms);
+    }
+    fmt::println("Tile log written to: {}", tile_log);
+}
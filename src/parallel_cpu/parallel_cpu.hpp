@@ -1,9 +1,142 @@
 #pragma once
 
 #include "core.hpp"
+#include "height_pyramid.hpp"
+#include "incremental.hpp"
+#include "numa.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+#include "tiling.hpp"
+#include <string>
 #include <vector>
 #include <cstdint>
 
-auto calculateVisibility(const std::vector<int16_t>& height_map, 
+/// The different ways `calculateVisibility` can evaluate the observers
+enum class Engine {
+    /// One observer and one ray at a time (`single_pixel_visiblity`)
+    scalar,
+    /// One observer at a time, several of its rays marched in lockstep
+    rays_simd,
+    /// A row segment of observers at a time, one ray direction at a time
+    observers_simd,
+    /// Like `scalar`, with a kernel compiled for the radius and number of
+    /// rays (`visibility<Radius, Angles>`). Falls back to `scalar` for
+    /// configurations without one.
+    specialized,
+    /// Like `scalar`, but skips the stretches of every ray that a
+    /// `HeightPyramid` of the map shows to be hidden. Falls back to `scalar`
+    /// when there is no pyramid.
+    pruned,
+    /// An approximation: one ray direction at a time, sharing each digital
+    /// line of the direction between all the observers on it
+    /// (`approx_line_visibility`). Its rays are not the walked ones of the
+    /// other engines, so its counts are different.
+    approx_lines,
+    /// Like `approx_lines`, but shears the whole map into each direction
+    /// first so the scan only reads rows of a buffer
+    /// (`rotated_raster_visibility`). Same counts as `approx_lines`.
+    rotated,
+    /// Walks each row reusing the heights and horizon bounds of the previous
+    /// observer (`incremental_visibility`). Same counts as `scalar`.
+    incremental,
+};
+
+/// What runs the tiles of observers on the threads
+enum class Backend {
+    /// An OpenMP loop over the tiles
+    openmp,
+    /// A `WorkStealingPool` of `std::thread`s
+    pool,
+    /// OpenMP threads that each run a fixed set of tiles, assigned up front
+    /// from the estimated cost of every tile (`lpt_assignment`)
+    lpt,
+};
+
+/// Every engine, in the order they are benchmarked
+constexpr Engine AllEngines[] = {Engine::scalar, Engine::rays_simd, Engine::observers_simd, Engine::specialized, Engine::pruned,
+                                 Engine::approx_lines, Engine::rotated, Engine::incremental};
+
+/// Runtime options of the shared memory solver
+struct Options {
+    Engine engine = Engine::scalar;
+    /// The instruction set of the SIMD engines, `best_isa()` by default
+    Isa isa = best_isa();
+    /// Time every engine against the scalar one before the actual run
+    bool bench = false;
+    /// The radius (in pixels) that every observer can see
+    int radius = 100;
+    /// How vertical angles are compared, only the scalar engine has `fixed`
+    SlopeMode slope = SlopeMode::floating;
+    /// The side of the square tiles of observers that the threads take, 0
+    /// picks one that fits the level 2 cache (`observer_tile_size`). Only
+    /// the `scalar`, `specialized` and `pruned` engines are tiled.
+    size_t tile_size = 0;
+    /// What runs the tiles
+    Backend backend = Backend::openmp;
+    /// The number of threads of `Backend::pool`, 0 for every core. `main`
+    /// sets it to the OpenMP thread count as well.
+    size_t threads = 0;
+    /// Where to write the estimated cost and time of every tile of
+    /// `Backend::lpt`, nowhere if empty
+    std::string tile_log;
+    /// Pin the threads of the tiled engines to the CPUs of `numa_placement`,
+    /// copy the height map to every NUMA node and let every thread place the
+    /// output of its tiles on its own node
+    bool numa = false;
+};
+
+/// How long one tile of `Backend::lpt` took against its estimate
+struct TileTiming {
+    Tile tile;
+    /// The worker that ran the tile
+    size_t worker;
+    /// `estimate_tile_cost` of the tile, in ray steps
+    double predicted_cost;
+    uint64_t actual_ns;
+};
+
+/// What the threads did during `calculateVisibility`
+struct RunStats {
+    /// How every worker spent the run, for `Backend::pool` and `Backend::lpt`
+    std::vector<WorkerStats> workers;
+    /// Every tile of `Backend::lpt`, in the order of `morton_tiles`
+    std::vector<TileTiming> tiles;
+    /// The heights that `Engine::incremental` read, if it ran
+    HeightLoads loads;
+};
+
+/// @returns where the threads of the tiled engines go in `Options::numa` mode,
+///          one per thread of `options.backend`
+[[nodiscard]]
+auto numa_placement(const Options& options) -> NumaPlacement;
+
+/// @returns `options.tile_size`, or the size of the tiles whose heights fit
+///          into the level 2 cache for `options.radius`
+[[nodiscard]]
+auto observer_tile_size(const Options& options) -> size_t;
+
+/// @param pyramid the block maxima of `height_map`, only used by `Engine::pruned`
+/// @param run_stats set to how the workers spent their time, if the tiles
+///        were run by `Backend::pool` or `Backend::lpt`, and to the heights
+///        that `Engine::incremental` read
+auto calculateVisibility(const tcb::span<const int16_t> height_map, 
                          size_t width, size_t height, 
-                         int radius = 100, int angle = 12) -> std::vector<unsigned int>;
\ No newline at end of file
+                         int radius = 100, int angle = 12,
+                         const Options& options = {},
+                         const HeightPyramid* pyramid = nullptr,
+                         RunStats* run_stats = nullptr) -> huge_vector<unsigned int>;
+
+/// Runs every engine on the same input and prints how long each one took and
+/// how many of its counts differ from the scalar engine.
+auto benchmarkEngines(const tcb::span<const int16_t> height_map,
+                      size_t width, size_t height,
+                      int radius, int angle,
+                      const Options& options,
+                      const HeightPyramid* pyramid) -> void;
+
+/// Prints how many heights per pixel the incremental engine read (if it ran)
+/// and how long every worker of `stats` was busy and idle. For the tiles
+/// of `Backend::lpt` it also prints how well their estimated costs match how
+/// long they took, and writes every tile to the CSV file `tile_log` (if it
+/// isn't empty).
+auto reportRunStats(const RunStats& stats, const std::string& tile_log) -> void;
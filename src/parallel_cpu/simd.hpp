@@ -0,0 +1,124 @@
+#pragma once
+
+#include "core.hpp"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/// The vector instruction sets that the SIMD kernels are compiled for. The
+/// kernels are built with function-level target attributes, so the binary
+/// still runs on machines without them and the choice is made at runtime.
+enum class Isa { scalar, avx2, avx512 };
+
+/// @returns the widest instruction set supported by the CPU running this process
+[[nodiscard]]
+auto best_isa() -> Isa;
+
+/// @returns true if the CPU running this process supports `isa`
+[[nodiscard]]
+auto isa_supported(const Isa isa) -> bool;
+
+/// @returns the number of 32-bit lanes in one vector register of `isa`
+[[nodiscard]]
+constexpr auto isa_lanes(const Isa isa) -> size_t
+{
+    switch (isa) {
+        case Isa::avx2: return 8;
+        case Isa::avx512: return 16;
+        default: return 1;
+    }
+}
+
+/// @returns the command line name of `isa`
+[[nodiscard]]
+auto isa_name(const Isa isa) -> std::string_view;
+
+/// A `RayStencil` rearranged so that `lanes` rays can be marched in lockstep,
+/// one ray per vector lane.
+///
+/// Rays are split into groups of `lanes`. For each group the step table is
+/// stored step-major, i.e. entry `[group][step][lane]`, so one step of every
+/// ray in the group is a single unit-stride vector load. Rays shorter than the
+/// longest ray of their group (and lanes without a ray) are padded, and
+/// `length()` tells the kernel when to mask each lane off.
+class LockstepStencil {
+public:
+    LockstepStencil(const RayStencil& stencil, const size_t lanes);
+
+    [[nodiscard]] auto lanes() const noexcept -> size_t { return lanes_; }
+    [[nodiscard]] auto num_groups() const noexcept -> size_t { return group_offsets_.size() - 1; }
+
+    /// @returns the number of steps of the longest ray in `group`
+    [[nodiscard]] auto group_steps(const size_t group) const noexcept -> size_t
+    {
+        return (group_offsets_[group + 1] - group_offsets_[group]) / lanes_;
+    }
+
+    /// @returns the index of the first entry of `group` in the step tables
+    [[nodiscard]] auto group_begin(const size_t group) const noexcept -> size_t { return group_offsets_[group]; }
+
+    /// @returns the number of steps of each ray, `num_groups() * lanes()` entries
+    [[nodiscard]] auto length() const noexcept -> const std::vector<int32_t>& { return length_; }
+    [[nodiscard]] auto dx() const noexcept -> const std::vector<int32_t>& { return dx_; }
+    [[nodiscard]] auto dy() const noexcept -> const std::vector<int32_t>& { return dy_; }
+    [[nodiscard]] auto inv_dist() const noexcept -> const std::vector<float>& { return inv_dist_; }
+
+private:
+    size_t lanes_;
+    std::vector<size_t> group_offsets_;
+    std::vector<int32_t> length_;
+    std::vector<int32_t> dx_;
+    std::vector<int32_t> dy_;
+    std::vector<float> inv_dist_;
+};
+
+/// Calculates the visibility of every pixel in row `y`, marching `isa_lanes(isa)`
+/// rays of each observer in lockstep. Produces exactly the same counts as
+/// `single_pixel_visiblity`.
+/// @param isa the instruction set to use, should match `lockstep.lanes()`.
+///        Without a supported one the row is calculated by `row_visibility`.
+/// @param y the row to process
+/// @param width the width of the height map
+/// @param height the height of the height map
+/// @param height_map the height map, at least two values long
+/// @param stencil the rays to cast
+/// @param lockstep the same rays, grouped for `isa`
+/// @param interior the observers that can skip the bounds checks
+/// @param output the `width` output values of row `y`
+auto simd_rays_row(
+    const Isa isa,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    const LockstepStencil& lockstep,
+    const InteriorRegion& interior,
+    unsigned int* output) -> void;
+
+/// Calculates the visibility of every pixel in row `y`, evaluating
+/// `isa_lanes(isa)` neighbouring observers of the row per vector register.
+///
+/// For a given ray step every observer of a row segment looks at the same
+/// offset, so the heights of a whole segment are one unit-stride load instead
+/// of a gather. Observers whose rays can leave the map on the left or right
+/// side are handed to `row_visibility` instead, and rows in the interior skip
+/// the remaining row check. Produces exactly the same counts as
+/// `single_pixel_visiblity`.
+/// @param isa the instruction set to use, must be supported
+/// @param y the row to process
+/// @param width the width of the height map
+/// @param height the height of the height map
+/// @param height_map the height map
+/// @param stencil the rays to cast
+/// @param interior the observers that can skip the bounds checks
+/// @param output the `width` output values of row `y`
+auto simd_observers_row(
+    const Isa isa,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    const InteriorRegion& interior,
+    unsigned int* output) -> void;
@@ -0,0 +1,162 @@
+#include "simd.hpp"
+#include <algorithm>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AWANNACU_X86 1
+#include <immintrin.h>
+#endif
+
+#ifdef AWANNACU_X86
+
+// Each lane is one observer of the segment starting at `x`. The caller makes
+// sure that no ray of any observer in the segment can leave the map on the
+// left or right side, so only the row of each step has to be checked. That
+// check is the same for the whole segment, which lets it `break` exactly
+// where the scalar kernel would for every observer. In the interior rows it
+// can't fail, so it is compiled out.
+
+template<bool CheckRows>
+__attribute__((target("avx2")))
+static auto segment_avx2(
+    const size_t x,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    unsigned int* output) -> void
+{
+    const int16_t* const row = height_map.data() + y * width + x;
+    const __m256 h0 = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row))));
+
+    const int32_t* const offsets_x = stencil.dx().data();
+    const int32_t* const offsets_y = stencil.dy().data();
+    const float* const inv_dist = stencil.inv_dist().data();
+
+    __m256i visible = _mm256_set1_epi32(1);
+
+    for (size_t ray = 0; ray < stencil.num_rays(); ++ray) {
+        __m256 max_angle_seen = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+
+        for (size_t step = stencil.ray_begin(ray); step < stencil.ray_end(ray); ++step) {
+            const int curr_y = static_cast<int>(y) + offsets_y[step];
+            if constexpr (CheckRows) {
+                if (curr_y < 0 || curr_y >= static_cast<int>(height)) {
+                    break; // Ray went out of bounds
+                }
+            }
+
+            // The heights of all observers' points are next to each other
+            const int16_t* const points = height_map.data() + static_cast<size_t>(curr_y) * width + x + offsets_x[step];
+            const __m256 point_height = _mm256_cvtepi32_ps(
+                _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(points))));
+
+            const __m256 angle = _mm256_mul_ps(_mm256_sub_ps(point_height, h0), _mm256_set1_ps(inv_dist[step]));
+            const __m256 higher = _mm256_cmp_ps(angle, max_angle_seen, _CMP_GT_OQ);
+
+            max_angle_seen = _mm256_max_ps(angle, max_angle_seen);
+            visible = _mm256_sub_epi32(visible, _mm256_castps_si256(higher));
+        }
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output), visible);
+}
+
+// GCC's plain AVX-512 intrinsics start from an undefined vector and then
+// warn that it's uninitialized, the zero masking ones don't
+constexpr __mmask16 AllLanes = 0xFFFF;
+
+template<bool CheckRows>
+__attribute__((target("avx512f")))
+static auto segment_avx512(
+    const size_t x,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    unsigned int* output) -> void
+{
+    const int16_t* const row = height_map.data() + y * width + x;
+    const __m512 h0 = _mm512_maskz_cvtepi32_ps(
+        AllLanes, _mm512_maskz_cvtepu16_epi32(AllLanes, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row))));
+
+    const int32_t* const offsets_x = stencil.dx().data();
+    const int32_t* const offsets_y = stencil.dy().data();
+    const float* const inv_dist = stencil.inv_dist().data();
+    const __m512i one = _mm512_set1_epi32(1);
+
+    __m512i visible = one;
+
+    for (size_t ray = 0; ray < stencil.num_rays(); ++ray) {
+        __m512 max_angle_seen = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+
+        for (size_t step = stencil.ray_begin(ray); step < stencil.ray_end(ray); ++step) {
+            const int curr_y = static_cast<int>(y) + offsets_y[step];
+            if constexpr (CheckRows) {
+                if (curr_y < 0 || curr_y >= static_cast<int>(height)) {
+                    break; // Ray went out of bounds
+                }
+            }
+
+            // The heights of all observers' points are next to each other
+            const int16_t* const points = height_map.data() + static_cast<size_t>(curr_y) * width + x + offsets_x[step];
+            const __m512 point_height = _mm512_maskz_cvtepi32_ps(
+                AllLanes, _mm512_maskz_cvtepu16_epi32(AllLanes, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(points))));
+
+            const __m512 angle = _mm512_mul_ps(_mm512_sub_ps(point_height, h0), _mm512_set1_ps(inv_dist[step]));
+            const __mmask16 higher = _mm512_cmp_ps_mask(angle, max_angle_seen, _CMP_GT_OQ);
+
+            max_angle_seen = _mm512_maskz_max_ps(AllLanes, angle, max_angle_seen);
+            visible = _mm512_mask_add_epi32(visible, higher, visible, one);
+        }
+    }
+
+    _mm512_storeu_si512(output, visible);
+}
+
+#endif
+
+auto simd_observers_row(
+    const Isa isa,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    const InteriorRegion& interior,
+    unsigned int* output) -> void
+{
+    const size_t lanes = isa_lanes(isa);
+    const bool check_rows = !interior.contains_row(y);
+
+    // Observers in [first, last) can't cast a ray off the left or right side
+    // of the map
+    const size_t first = interior.x_begin;
+    const size_t last = interior.x_end;
+
+    // Handle the left border one observer at a time
+    size_t x = std::min(first, width);
+    row_visibility(y, 0, x, width, height, height_map, stencil, interior, output);
+
+    // Vectorize over as many full segments as fit
+    for (; lanes > 1 && x + lanes <= last; x += lanes) {
+        switch (isa) {
+#ifdef AWANNACU_X86
+            case Isa::avx2:
+                check_rows ? segment_avx2<true>(x, y, width, height, height_map, stencil, output + x)
+                           : segment_avx2<false>(x, y, width, height, height_map, stencil, output + x);
+                break;
+            case Isa::avx512:
+                check_rows ? segment_avx512<true>(x, y, width, height, height_map, stencil, output + x)
+                           : segment_avx512<false>(x, y, width, height, height_map, stencil, output + x);
+                break;
+#endif
+            default: break;
+        }
+    }
+
+    // And whatever is left over (the right border)
+    row_visibility(y, x, width, width, height, height_map, stencil, interior, output + x);
+}
@@ -0,0 +1,282 @@
+#include "simd.hpp"
+#include <algorithm>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AWANNACU_X86 1
+#include <immintrin.h>
+#endif
+
+auto isa_supported(const Isa isa) -> bool
+{
+    switch (isa) {
+        case Isa::scalar:
+            return true;
+#ifdef AWANNACU_X86
+        case Isa::avx2:
+            return __builtin_cpu_supports("avx2");
+        case Isa::avx512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+auto best_isa() -> Isa
+{
+    if (isa_supported(Isa::avx512)) { return Isa::avx512; }
+    if (isa_supported(Isa::avx2)) { return Isa::avx2; }
+    return Isa::scalar;
+}
+
+auto isa_name(const Isa isa) -> std::string_view
+{
+    switch (isa) {
+        case Isa::avx2: return "avx2";
+        case Isa::avx512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+LockstepStencil::LockstepStencil(const RayStencil& stencil, const size_t lanes) : lanes_(lanes)
+{
+    const size_t num_groups = (stencil.num_rays() + lanes - 1) / lanes;
+
+    group_offsets_.reserve(num_groups + 1);
+    group_offsets_.push_back(0);
+    length_.resize(num_groups * lanes, 0);
+
+    for (size_t group = 0; group < num_groups; ++group) {
+        // Find the longest ray of the group, the whole group is padded to it
+        size_t steps = 0;
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            const size_t ray = group * lanes + lane;
+            if (ray < stencil.num_rays()) {
+                const size_t length = stencil.ray_end(ray) - stencil.ray_begin(ray);
+                length_[ray] = static_cast<int32_t>(length);
+                steps = std::max(steps, length);
+            }
+        }
+
+        // Padded entries are never read, because their lane is masked off by
+        // `length_`, so they can be anything
+        const size_t begin = group_offsets_.back();
+        dx_.resize(begin + steps * lanes, 0);
+        dy_.resize(begin + steps * lanes, 0);
+        inv_dist_.resize(begin + steps * lanes, 0.0f);
+
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            const size_t ray = group * lanes + lane;
+            if (ray >= stencil.num_rays()) { continue; }
+
+            for (size_t step = 0; step < stencil.ray_end(ray) - stencil.ray_begin(ray); ++step) {
+                const size_t from = stencil.ray_begin(ray) + step;
+                const size_t to = begin + step * lanes + lane;
+                dx_[to] = stencil.dx()[from];
+                dy_[to] = stencil.dy()[from];
+                inv_dist_[to] = stencil.inv_dist()[from];
+            }
+        }
+
+        group_offsets_.push_back(begin + steps * lanes);
+    }
+}
+
+#ifdef AWANNACU_X86
+
+// Both kernels gather 32 bits at the 16-bit index of each height, which also
+// reads the next height. To never read past the end of the map the index is
+// clamped to the second to last value, and the gathered word is shifted down
+// by 16 bits for the lanes that asked for the very last one. Masking with
+// 0xFFFF then gives the height as an `unsigned short`, the same conversion
+// the scalar kernel does.
+
+template<bool CheckBounds>
+__attribute__((target("avx2")))
+static auto pixel_avx2(
+    const size_t x,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const LockstepStencil& stencil) -> unsigned int
+{
+    const auto* const base = reinterpret_cast<const int*>(height_map.data());
+    const float current_height = static_cast<float>(static_cast<uint16_t>(height_map[y * width + x]));
+
+    const __m256i obs_x = _mm256_set1_epi32(static_cast<int>(x));
+    const __m256i obs_y = _mm256_set1_epi32(static_cast<int>(y));
+    const __m256i map_w = _mm256_set1_epi32(static_cast<int>(width));
+    const __m256i map_h = _mm256_set1_epi32(static_cast<int>(height));
+    const __m256i minus_one = _mm256_set1_epi32(-1);
+    const __m256i last_index = _mm256_set1_epi32(static_cast<int>(height_map.size() - 2));
+    const __m256i low_half = _mm256_set1_epi32(0xFFFF);
+    const __m256 h0 = _mm256_set1_ps(current_height);
+
+    __m256i visible = _mm256_setzero_si256();
+
+    for (size_t group = 0; group < stencil.num_groups(); ++group) {
+        const __m256i length = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(stencil.length().data() + group * 8));
+        __m256 max_angle_seen = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+        __m256i alive = minus_one;
+
+        size_t entry = stencil.group_begin(group);
+        for (size_t step = 0; step < stencil.group_steps(group); ++step, entry += 8) {
+            // Mask off the rays that are out of steps
+            alive = _mm256_and_si256(alive, _mm256_cmpgt_epi32(length, _mm256_set1_epi32(static_cast<int>(step))));
+
+            // ... and the ones that left the map (for good, like the scalar `break`)
+            const __m256i curr_x = _mm256_add_epi32(obs_x, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stencil.dx().data() + entry)));
+            const __m256i curr_y = _mm256_add_epi32(obs_y, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stencil.dy().data() + entry)));
+            if constexpr (CheckBounds) {
+                const __m256i in_x = _mm256_and_si256(_mm256_cmpgt_epi32(curr_x, minus_one), _mm256_cmpgt_epi32(map_w, curr_x));
+                const __m256i in_y = _mm256_and_si256(_mm256_cmpgt_epi32(curr_y, minus_one), _mm256_cmpgt_epi32(map_h, curr_y));
+                alive = _mm256_and_si256(alive, _mm256_and_si256(in_x, in_y));
+            }
+
+            if (_mm256_testz_si256(alive, alive)) { break; }
+
+            // Gather the heights of the live lanes
+            const __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(curr_y, map_w), curr_x);
+            const __m256i clamped = _mm256_min_epi32(index, last_index);
+            const __m256i shift = _mm256_slli_epi32(_mm256_sub_epi32(index, clamped), 4);
+            const __m256i words = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base, clamped, alive, 2);
+            const __m256i heights = _mm256_and_si256(_mm256_srlv_epi32(words, shift), low_half);
+
+            // Calculate the vertical angle to each point and count the new maxima
+            const __m256 diff = _mm256_sub_ps(_mm256_cvtepi32_ps(heights), h0);
+            const __m256 angle = _mm256_mul_ps(diff, _mm256_loadu_ps(stencil.inv_dist().data() + entry));
+            const __m256i higher = _mm256_and_si256(
+                _mm256_castps_si256(_mm256_cmp_ps(angle, max_angle_seen, _CMP_GT_OQ)), alive);
+
+            max_angle_seen = _mm256_blendv_ps(max_angle_seen, angle, _mm256_castsi256_ps(higher));
+            visible = _mm256_sub_epi32(visible, higher);
+        }
+    }
+
+    // Sum the per-lane counts
+    const __m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(visible), _mm256_extracti128_si256(visible, 1));
+    const __m128i sum2 = _mm_add_epi32(sum4, _mm_unpackhi_epi64(sum4, sum4));
+    const __m128i sum1 = _mm_add_epi32(sum2, _mm_shuffle_epi32(sum2, 1));
+
+    // The pixel itself is always visible
+    return 1 + static_cast<unsigned int>(_mm_cvtsi128_si32(sum1));
+}
+
+// GCC's plain AVX-512 intrinsics start from an undefined vector and then
+// warn that it's uninitialized. The zero masking ones with every lane set do
+// the same thing without it.
+constexpr __mmask16 AllLanes = 0xFFFF;
+
+template<bool CheckBounds>
+__attribute__((target("avx512f")))
+static auto pixel_avx512(
+    const size_t x,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const LockstepStencil& stencil) -> unsigned int
+{
+    const auto* const base = height_map.data();
+    const float current_height = static_cast<float>(static_cast<uint16_t>(height_map[y * width + x]));
+
+    const __m512i obs_x = _mm512_set1_epi32(static_cast<int>(x));
+    const __m512i obs_y = _mm512_set1_epi32(static_cast<int>(y));
+    const __m512i map_w = _mm512_set1_epi32(static_cast<int>(width));
+    const __m512i map_h = _mm512_set1_epi32(static_cast<int>(height));
+    const __m512i minus_one = _mm512_set1_epi32(-1);
+    const __m512i last_index = _mm512_set1_epi32(static_cast<int>(height_map.size() - 2));
+    const __m512i low_half = _mm512_set1_epi32(0xFFFF);
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512 h0 = _mm512_set1_ps(current_height);
+
+    __m512i visible = _mm512_setzero_si512();
+
+    for (size_t group = 0; group < stencil.num_groups(); ++group) {
+        const __m512i length = _mm512_loadu_si512(stencil.length().data() + group * 16);
+        __m512 max_angle_seen = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+        __mmask16 alive = 0xFFFF;
+
+        size_t entry = stencil.group_begin(group);
+        for (size_t step = 0; step < stencil.group_steps(group); ++step, entry += 16) {
+            // Mask off the rays that are out of steps
+            alive = _mm512_mask_cmpgt_epi32_mask(alive, length, _mm512_set1_epi32(static_cast<int>(step)));
+
+            // ... and the ones that left the map (for good, like the scalar `break`)
+            const __m512i curr_x = _mm512_add_epi32(obs_x, _mm512_loadu_si512(stencil.dx().data() + entry));
+            const __m512i curr_y = _mm512_add_epi32(obs_y, _mm512_loadu_si512(stencil.dy().data() + entry));
+            if constexpr (CheckBounds) {
+                alive = _mm512_mask_cmpgt_epi32_mask(alive, curr_x, minus_one);
+                alive = _mm512_mask_cmpgt_epi32_mask(alive, map_w, curr_x);
+                alive = _mm512_mask_cmpgt_epi32_mask(alive, curr_y, minus_one);
+                alive = _mm512_mask_cmpgt_epi32_mask(alive, map_h, curr_y);
+            }
+
+            if (alive == 0) { break; }
+
+            // Gather the heights of the live lanes
+            const __m512i index = _mm512_add_epi32(_mm512_mullo_epi32(curr_y, map_w), curr_x);
+            const __m512i clamped = _mm512_maskz_min_epi32(AllLanes, index, last_index);
+            const __m512i shift = _mm512_maskz_slli_epi32(AllLanes, _mm512_sub_epi32(index, clamped), 4);
+            const __m512i words = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), alive, clamped, base, 2);
+            const __m512i heights = _mm512_and_si512(_mm512_maskz_srlv_epi32(AllLanes, words, shift), low_half);
+
+            // Calculate the vertical angle to each point and count the new maxima
+            const __m512 diff = _mm512_sub_ps(_mm512_maskz_cvtepi32_ps(AllLanes, heights), h0);
+            const __m512 angle = _mm512_mul_ps(diff, _mm512_loadu_ps(stencil.inv_dist().data() + entry));
+            const __mmask16 higher = _mm512_mask_cmp_ps_mask(alive, angle, max_angle_seen, _CMP_GT_OQ);
+
+            max_angle_seen = _mm512_mask_mov_ps(max_angle_seen, higher, angle);
+            visible = _mm512_mask_add_epi32(visible, higher, visible, one);
+        }
+    }
+
+    // Sum up the halves like the AVX2 kernel does
+    const __m256i sum8 = _mm256_add_epi32(
+        _mm512_maskz_extracti64x4_epi64(0xF, visible, 0), _mm512_maskz_extracti64x4_epi64(0xF, visible, 1));
+    const __m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(sum8), _mm256_extracti128_si256(sum8, 1));
+    const __m128i sum2 = _mm_add_epi32(sum4, _mm_unpackhi_epi64(sum4, sum4));
+    const __m128i sum1 = _mm_add_epi32(sum2, _mm_shuffle_epi32(sum2, 1));
+
+    // The pixel itself is always visible
+    return 1 + static_cast<unsigned int>(_mm_cvtsi128_si32(sum1));
+}
+
+#endif
+
+auto simd_rays_row(
+    const Isa isa,
+    const size_t y,
+    const size_t width,
+    const size_t height,
+    const tcb::span<const int16_t> height_map,
+    const RayStencil& stencil,
+    const LockstepStencil& lockstep,
+    const InteriorRegion& interior,
+    unsigned int* output) -> void
+{
+    switch (isa) {
+#ifdef AWANNACU_X86
+        case Isa::avx2:
+            for (size_t x = 0; x < width; ++x) {
+                output[x] = interior.contains(x, y)
+                    ? pixel_avx2<false>(x, y, width, height, height_map, lockstep)
+                    : pixel_avx2<true>(x, y, width, height, height_map, lockstep);
+            }
+            return;
+        case Isa::avx512:
+            for (size_t x = 0; x < width; ++x) {
+                output[x] = interior.contains(x, y)
+                    ? pixel_avx512<false>(x, y, width, height, height_map, lockstep)
+                    : pixel_avx512<true>(x, y, width, height, height_map, lockstep);
+            }
+            return;
+#endif
+        default:
+            row_visibility(y, 0, width, width, height, height_map, stencil, interior, output);
+            return;
+    }
+}
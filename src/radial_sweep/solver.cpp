@@ -0,0 +1,60 @@
+#include "solver.hpp"
+#include "radial_sweep.hpp"
+#include <fmt/core.h>
+#include <vector>
+
+auto solve(const std::filesystem::path input_file, const std::filesystem::path output_file,
+           const size_t width, const size_t height, const int radius) -> void
+{
+    // Check if the input file exists.
+    if (!std::filesystem::exists(input_file)) {
+        fmt::println("Error: Input file {} does not exist.", input_file.string());
+        return;
+    }
+
+    // Read the input file.
+    auto heights = read_input(input_file);
+
+    // Validate the input file
+    if (heights.size() != height * width) {
+        fmt::println("Error: Input file {} has an incorrect size. Expected {} values, but got {}.", input_file.string(), height * width, heights.size());
+        return;
+    }
+
+    auto outputs = std::vector<uint32_t>(heights.size(), 0);
+
+    // Wrap the heights and outputs in multi-dimensional spans, one row of the
+    // file per `y`
+    auto h = to_span(tcb::span(heights.data(), heights.size()), height, width);
+    auto o = to_span(tcb::span(outputs.data(), outputs.size()), height, width);
+
+    // Call the solving algorithm
+    detail::solve(h, o, radius);
+
+    // Write results to the output file
+    write_output<uint32_t>(output_file, outputs);
+}
+
+auto detail::solve(mat_2d_i16 heights, mat_2d_u32 outputs, const int radius) -> void
+{
+    if (heights.extents() != outputs.extents()) {
+        fmt::println("Spans passed into the solver are not equivalently sized!");
+        return;
+    }
+
+    // The cells and sweep events are the same for every observer
+    const SweepStencil stencil(radius);
+
+#pragma omp parallel
+    {
+        // Every thread sweeps with its own segment tree
+        RadialSweep sweep(stencil);
+
+#pragma omp for schedule(dynamic)
+        for (size_t y = 0; y < heights.extent(0); ++y) {
+            for (size_t x = 0; x < heights.extent(1); ++x) {
+                outputs(y, x) = sweep.count_visible(x, y, heights);
+            }
+        }
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "core.hpp"
+#include <filesystem>
+
+/// Counts the cells visible from every cell of the input with an exact
+/// radial sweep, and writes the counts (as `uint32_t`) to the output.
+auto solve(const std::filesystem::path input_file, const std::filesystem::path output_file,
+           const size_t width, const size_t height, const int radius = 100) -> void;
+
+namespace detail {
+    /// @param heights the height map, indexed `heights(y, x)`
+    /// @param outputs the visible counts, indexed like `heights`
+    auto solve(mat_2d_i16 heights, mat_2d_u32 outputs, const int radius) -> void;
+}
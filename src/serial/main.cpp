@@ -5,6 +5,10 @@
 #include <cstdlib>
 #include <chrono>
 
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
 [[nodiscard]]
 static inline auto bad_usage(const tcb::span<char*> args) -> int;
 
@@ -15,13 +19,29 @@ auto main(int argc, char** argv) -> int
     if (args.size() < 3) { return bad_usage(args); }
 
     const auto [width, height] = [&]() -> std::pair<size_t, size_t>{
-        if (args.size() == 5) {
+        if (args.size() >= 5) {
             return {std::atoi(args[3]), std::atoi(args[4])};
         } else {
             return {6000, 6000};
         }
     }();
 
+    // 0 threads (or none given) means every core
+    const auto num_threads = args.size() == 6 ? std::atoi(args[5]) : 0;
+    if (num_threads < 0) {
+        fmt::println("The number of threads can't be negative");
+        return bad_usage(args);
+    }
+
+#ifdef _OPENMP
+    // set the number of threads to use, OpenMP itself would run 0 threads as 1
+    if (args.size() == 6) {
+        const auto threads = num_threads > 0 ? num_threads : omp_get_num_procs();
+        omp_set_num_threads(threads);
+        fmt::println("Set number of threads to {}", threads);
+    }
+#endif
+
     // time the algorithm
     timer time;
     time.reset();
@@ -36,6 +56,7 @@ auto main(int argc, char** argv) -> int
 
 auto bad_usage(const tcb::span<char*> args) -> int 
 {
-    fmt::println("Usage: {} <input-file> <output-file> [<width> <height>]", args[0]);
+    fmt::println("Usage: {} <input-file> <output-file> [<width> <height> [<threads>]]", args[0]);
+    fmt::println("  <threads> of 0 uses every core");
     return EXIT_FAILURE;
 }
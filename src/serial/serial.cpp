@@ -30,7 +30,7 @@ auto solve(const std::filesystem::path input_file, const std::filesystem::path o
     }
 
     // Read the input file.
-    auto heights = read_input(input_file);
+    auto heights = read_input<huge_page_allocator<int16_t>>(input_file);
 
     // Validate the input file
     if (heights.size() != height * width) {
@@ -39,21 +39,26 @@ auto solve(const std::filesystem::path input_file, const std::filesystem::path o
     }
 
     // Reuse the ints vector as the output vector (sneaky sneaky, I know)
-    auto outputs = std::vector<int16_t>(heights.size(), 0);
+    auto outputs = huge_vector<int16_t>(heights.size(), 0);
 
-    // Wrap the heights and outputs in multi-dimensional spans 
-    auto h = to_span(tcb::span(heights.data(), heights.size()), width, height);
-    auto o = to_span(tcb::span(outputs.data(), outputs.size()), width, height);
+    // Wrap the heights and outputs in row-major grids
+    auto h = to_grid(tcb::span(heights.data(), heights.size()), width, height);
+    auto o = to_grid(tcb::span(outputs.data(), outputs.size()), width, height);
 
     // Call the solving algorithm
     detail::solve(h, o);
 
+    // Whether the kernel found huge pages for the big arrays
+    fmt::println("Huge pages: height map {}, output {}",
+        describe_huge_pages(huge_page_usage(heights.data(), heights.size() * sizeof(int16_t))),
+        describe_huge_pages(huge_page_usage(outputs.data(), outputs.size() * sizeof(int16_t))));
+
     // Write results to the output file
     write_output<int16_t>(output_file, outputs);
 }
 
-auto detail::solve(mat_2d_i16 heights, mat_2d_i16 outputs) -> void {
-    if (heights.extents() != outputs.extents()) {
+auto detail::solve(grid_i16 heights, grid_i16 outputs) -> void {
+    if (heights.rows() != outputs.rows() || heights.cols() != outputs.cols()) {
         fmt::println("Spans passed into the solver are not equivalently sized!");
         return;
     }
@@ -61,31 +66,34 @@ auto detail::solve(mat_2d_i16 heights, mat_2d_i16 outputs) -> void {
     // precompute the circular offsets
     const auto pixel_offsets = circle_points<Radius>();
 
-    // Set up the static storage for the "seen" variables
-    auto seen_storage = std::vector<uint8_t>(SeenDim * SeenDim, false);
-    auto seen = Kokkos::mdspan(seen_storage.data(), SeenDim, SeenDim);
-
-    // Checks if point is in array
-    auto is_valid_point = [&](const auto x, const auto y) {
-        return x >= 0 && x < heights.extent(0) && y >= 0 && y < heights.extent(1);
-    };
-
-    // Check visibility for each point
-    for (int64_t y = 0; y < heights.extent(1); y++) {
-        for (int64_t x = 0; x < heights.extent(0); x++) {
-            // ensure the outputs starts at 0
-            outputs(x, y) = 0;
-
-            // reset the seen storage
-            std::fill(seen_storage.begin(), seen_storage.end(), false);
-
-            // calculate how many points can be seen from (x,y)
-            for (const auto& [x_offset, y_offset] : pixel_offsets) {
-                const auto x_ = x + x_offset;
-                const auto y_ = y + y_offset;
-
-                if (is_valid_point(x_, y_)) {
-                    outputs(x, y) += detail::is_visible_from(vec2{x, y}, vec2{x_, y_}, heights, seen, 6);
+    // Check visibility for each point, walking along the rows so that
+    // neighbouring observers are next to each other in memory. Every thread
+    // takes whole rows, the observers near the edges of the map have fewer
+    // cells to look at so the rows are handed out as they finish.
+    const auto rows = static_cast<int64_t>(heights.rows());
+    const auto cols = static_cast<int64_t>(heights.cols());
+#pragma omp parallel
+    {
+        // Every thread keeps its own "seen" cells
+        auto seen = SeenCells();
+
+#pragma omp for schedule(dynamic, 1)
+        for (int64_t y = 0; y < rows; y++) {
+            for (int64_t x = 0; x < cols; x++) {
+                // ensure the outputs starts at 0
+                outputs(y, x) = 0;
+
+                // start with nothing seen
+                seen.next_observer();
+
+                // calculate how many points can be seen from (x,y)
+                for (const auto& [x_offset, y_offset] : pixel_offsets) {
+                    const auto x_ = x + x_offset;
+                    const auto y_ = y + y_offset;
+
+                    if (heights.contains(y_, x_)) {
+                        outputs(y, x) += detail::is_visible_from(vec2{x, y}, vec2{x_, y_}, heights, seen, 6);
+                    }
                 }
             }
         }
@@ -9,16 +9,60 @@
 auto solve(const std::filesystem::path input_file, const std::filesystem::path output_file, const size_t width = 6000, const size_t height = 6000) -> void;
 
 namespace detail {
-    auto solve(mat_2d_i16 heights, mat_2d_i16 outputs) -> void;
+    constexpr size_t Radius = 100;
+    // Offsets go from -Radius to +Radius inclusive
+    constexpr size_t SeenDim = 2 * Radius + 1;
+
+    /// The cells around an observer that have already been counted.
+    ///
+    /// Every cell holds the stamp of the last observer that saw it, and a
+    /// cell is seen if its stamp is the current one. Moving on to the next
+    /// observer only bumps the stamp, so nothing has to be cleared between
+    /// observers, except once every time the stamps wrap around.
+    class SeenCells {
+    public:
+        SeenCells() : stamps_(SeenDim * SeenDim, 0) {}
+
+        /// Forgets every seen cell, call before each observer
+        auto next_observer() -> void
+        {
+            if (++epoch_ == 0) {
+                std::fill(stamps_.begin(), stamps_.end(), uint16_t{0});
+                epoch_ = 1;
+            }
+        }
+
+        /// @returns true if `(row, col)` was seen by the current observer
+        [[nodiscard]] auto is_seen(const int64_t row, const int64_t col) const -> bool
+        {
+            return grid()(row, col) == epoch_;
+        }
+
+        /// Marks `(row, col)` as seen
+        /// @returns true if the cell wasn't seen before
+        auto mark(const int64_t row, const int64_t col) -> bool
+        {
+            auto& stamp = grid()(row, col);
+            const bool first = stamp != epoch_;
+            stamp = epoch_;
+            return first;
+        }
+
+    private:
+        [[nodiscard]] auto grid() const -> grid2d<const uint16_t> { return {stamps_.data(), SeenDim, SeenDim}; }
+        [[nodiscard]] auto grid() -> grid2d<uint16_t> { return {stamps_.data(), SeenDim, SeenDim}; }
+
+        std::vector<uint16_t> stamps_;
+        uint16_t epoch_{0};
+    };
+
+    auto solve(grid_i16 heights, grid_i16 outputs) -> void;
     
     template<size_t Radius>
     auto circle_points() -> std::vector<std::pair<int64_t, int64_t>>;
     
     template<typename T>
-    auto is_visible_from(const vec2<T> from, const vec2<T> to, const mat_2d_i16 heights, mat_2d_u8 seen, const int16_t vantage = 0) -> int16_t;
-
-    constexpr size_t Radius = 100;
-    constexpr size_t SeenDim = 2 * (Radius);
+    auto is_visible_from(const vec2<T> from, const vec2<T> to, const grid_i16 heights, SeenCells& seen, const int16_t vantage = 0) -> int16_t;
 }
 
 template<size_t Radius>
@@ -74,7 +118,7 @@ auto detail::circle_points() -> std::vector<std::pair<int64_t, int64_t>>
 }
 
 template<typename T>
-auto detail::is_visible_from(const vec2<T> from, const vec2<T> to, const mat_2d_i16 heights, mat_2d_u8 seen, const int16_t vantage) -> int16_t
+auto detail::is_visible_from(const vec2<T> from, const vec2<T> to, const grid_i16 heights, SeenCells& seen, const int16_t vantage) -> int16_t
 {
     const auto dx = std::abs(to.x - from.x);
     const auto dy = std::abs(to.y - from.y);
@@ -116,7 +160,7 @@ auto detail::is_visible_from(const vec2<T> from, const vec2<T> to, const mat_2d_
             break;
         }
 
-        if (!seen(translate_to_seen_coordinates_x(x), translate_to_seen_coordinates_y(y))) {
+        if (!seen.is_seen(translate_to_seen_coordinates_y(y), translate_to_seen_coordinates_x(x))) {
             break;
         }
         
@@ -136,7 +180,7 @@ auto detail::is_visible_from(const vec2<T> from, const vec2<T> to, const mat_2d_
     // This is the second call to the algorithm, where the seen squares are actually added up.
     int16_t seen_count = 0;
     double max_angle = std::numeric_limits<double>::lowest();
-    const auto from_height = heights(from.x, from.y) + vantage;
+    const auto from_height = heights(from.y, from.x) + vantage;
     auto length = double{0};
 
     while(1)
@@ -157,7 +201,7 @@ auto detail::is_visible_from(const vec2<T> from, const vec2<T> to, const mat_2d_
         }
 
         const auto angle_approx = [&](){
-            const auto height = heights(x, y);
+            const auto height = heights(y, x);
             const auto z_ = height - from_height;
 
             length += step;
@@ -172,10 +216,8 @@ auto detail::is_visible_from(const vec2<T> from, const vec2<T> to, const mat_2d_
             const auto x_ = translate_to_seen_coordinates_x(x);
             const auto y_ = translate_to_seen_coordinates_y(y);
             
-            auto& seen_ = seen(x_, y_);
-            if (!seen_) {
+            if (seen.mark(y_, x_)) {
                 seen_count++;
-                seen_ = true;
             }
         }
     }